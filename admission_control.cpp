@@ -0,0 +1,377 @@
+#include "admission_control.h"
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    const char* kSegmentName = "/phllama_admission";
+    const uint32_t kMagic = 0x50484143; // "PHAC"
+    const uint32_t kLayoutVersion = 1;
+    const int kMaxHolders = 256;
+    const int kMaxWaiters = 1024;
+    const auto kReapInterval = std::chrono::milliseconds(100); // Waiters re-check for dead holders
+    
+    struct Holder {
+        pid_t pid;
+        uint64_t ticket;
+    };
+    
+    struct Waiter {
+        pid_t pid;
+        int32_t priority;
+        uint64_t ticket;
+    };
+    
+    /**
+     * Layout of the shared segment; every field is guarded by `mutex`
+     */
+    struct SharedState {
+        std::atomic<uint32_t> ready; // Set to kMagic once the creator has initialized the rest
+        uint32_t version;
+        uint32_t size;
+        pthread_mutex_t mutex;  // Process-shared and robust
+        pthread_cond_t changed; // Process-shared, CLOCK_MONOTONIC
+        int32_t max_concurrent;
+        uint64_t next_ticket;
+        Holder holders[kMaxHolders];
+        Waiter waiters[kMaxWaiters];
+        uint64_t admitted;
+        uint64_t rejected;
+        uint64_t timed_out;
+        uint64_t total_wait_us;
+        uint64_t max_wait_us;
+    };
+    
+    std::mutex config_mutex;
+    AdmissionControl::Config config;
+    SharedState* shared = nullptr; // Mapped once per process, inherited across fork
+    
+    void initializeState(SharedState* state) {
+        pthread_mutexattr_t mutex_attr;
+        pthread_mutexattr_init(&mutex_attr);
+        pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&state->mutex, &mutex_attr);
+        pthread_mutexattr_destroy(&mutex_attr);
+        
+        pthread_condattr_t cond_attr;
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+        pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&state->changed, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+        
+        state->version = kLayoutVersion;
+        state->size = sizeof(SharedState);
+        state->next_ticket = 1;
+        state->ready.store(kMagic, std::memory_order_release);
+    }
+    
+    /**
+     * Open (or create and initialize) the shared segment
+     * Must be called with config_mutex held
+     */
+    SharedState* openShared() {
+        if (shared) {
+            return shared;
+        }
+        
+        bool created = true;
+        int fd = shm_open(kSegmentName, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            created = false;
+            fd = shm_open(kSegmentName, O_RDWR, 0600);
+        }
+        if (fd < 0) {
+            throw std::runtime_error(std::string("Cannot open admission control segment: ") + std::strerror(errno));
+        }
+        
+        if (created) {
+            if (ftruncate(fd, sizeof(SharedState)) != 0) {
+                close(fd);
+                shm_unlink(kSegmentName);
+                throw std::runtime_error(std::string("Cannot size admission control segment: ") + std::strerror(errno));
+            }
+        } else {
+            // The creator may still be sizing it
+            struct stat st;
+            for (int i = 0; i < 1000 && fstat(fd, &st) == 0 && st.st_size < static_cast<off_t>(sizeof(SharedState)); i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        
+        void* mapping = mmap(nullptr, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error(std::string("Cannot map admission control segment: ") + std::strerror(errno));
+        }
+        
+        auto* state = static_cast<SharedState*>(mapping);
+        if (created) {
+            initializeState(state); // A fresh segment is zero-filled
+        } else {
+            for (int i = 0; i < 1000 && state->ready.load(std::memory_order_acquire) != kMagic; i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (state->ready.load(std::memory_order_acquire) != kMagic ||
+                state->version != kLayoutVersion || state->size != sizeof(SharedState)) {
+                munmap(mapping, sizeof(SharedState));
+                throw std::runtime_error(std::string("Admission control segment /dev/shm") + kSegmentName +
+                                         " is from an incompatible version; remove it once no workers are running");
+            }
+        }
+        
+        shared = state;
+        return shared;
+    }
+    
+    bool processAlive(pid_t pid) {
+        return kill(pid, 0) == 0 || errno != ESRCH;
+    }
+    
+    /**
+     * Drop holders and waiters whose process has exited
+     */
+    void reap(SharedState* state) {
+        bool released = false;
+        for (auto& holder : state->holders) {
+            if (holder.pid != 0 && !processAlive(holder.pid)) {
+                holder = Holder{};
+                released = true;
+            }
+        }
+        for (auto& waiter : state->waiters) {
+            if (waiter.pid != 0 && !processAlive(waiter.pid)) {
+                waiter = Waiter{};
+                released = true;
+            }
+        }
+        if (released) {
+            pthread_cond_broadcast(&state->changed);
+        }
+    }
+    
+    /**
+     * Lock the shared state, recovering it if the previous owner died holding the lock
+     */
+    void lockState(SharedState* state) {
+        int rc = pthread_mutex_lock(&state->mutex);
+        if (rc == EOWNERDEAD) {
+            pthread_mutex_consistent(&state->mutex);
+            reap(state);
+        } else if (rc != 0) {
+            throw std::runtime_error(std::string("Cannot lock admission control segment: ") + std::strerror(rc));
+        }
+    }
+    
+    int countRunning(const SharedState* state) {
+        int running = 0;
+        for (const auto& holder : state->holders) {
+            running += holder.pid != 0;
+        }
+        return running;
+    }
+    
+    int countWaiting(const SharedState* state) {
+        int waiting = 0;
+        for (const auto& waiter : state->waiters) {
+            waiting += waiter.pid != 0;
+        }
+        return waiting;
+    }
+    
+    /**
+     * Whether no other waiter is ahead: higher priority, or equal priority and earlier ticket
+     */
+    bool isFirst(const SharedState* state, const Waiter& self) {
+        for (const auto& other : state->waiters) {
+            if (other.pid == 0 || other.ticket == self.ticket) {
+                continue;
+            }
+            if (other.priority > self.priority ||
+                (other.priority == self.priority && other.ticket < self.ticket)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    timespec monotonicAfter(std::chrono::steady_clock::duration wait) {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+        ts.tv_sec += ns / 1000000000;
+        ts.tv_nsec += ns % 1000000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        return ts;
+    }
+}
+
+/**
+ * Wait for a slot until `deadline`
+ */
+AdmissionControl::Slot::Slot(AdmissionPriority priority, std::chrono::steady_clock::time_point deadline) {
+    Config current;
+    SharedState* state;
+    {
+        std::lock_guard<std::mutex> lock(config_mutex);
+        current = config;
+        if (current.max_concurrent <= 0) {
+            return;
+        }
+        state = openShared();
+    }
+    
+    const pid_t pid = getpid();
+    const auto start_time = std::chrono::steady_clock::now();
+    
+    lockState(state);
+    state->max_concurrent = std::min(current.max_concurrent, kMaxHolders); // Last configured process wins
+    reap(state);
+    
+    Waiter* self = nullptr;
+    int waiting = countWaiting(state);
+    bool full = (current.queue_limit > 0 && waiting >= current.queue_limit) || waiting >= kMaxWaiters;
+    bool immediate = countRunning(state) < state->max_concurrent && waiting == 0;
+    
+    if (full || (current.fast_fail && !immediate)) {
+        state->rejected++;
+        pthread_mutex_unlock(&state->mutex);
+        throw AdmissionError(full ? "Inference queue is full (" + std::to_string(waiting) + " waiting)" :
+                                    "No inference slot free (fast-fail)");
+    }
+    
+    for (auto& waiter : state->waiters) {
+        if (waiter.pid == 0) {
+            waiter = Waiter{pid, static_cast<int32_t>(priority), state->next_ticket++};
+            self = &waiter;
+            break;
+        }
+    }
+    
+    while (true) {
+        if (countRunning(state) < state->max_concurrent && isFirst(state, *self)) {
+            for (auto& holder : state->holders) {
+                if (holder.pid == 0) {
+                    holder = Holder{pid, self->ticket};
+                    break;
+                }
+            }
+            ticket = self->ticket;
+            *self = Waiter{};
+            
+            auto waited = std::chrono::steady_clock::now() - start_time;
+            uint64_t waited_us = std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+            wait_ms = waited_us / 1000.0;
+            state->admitted++;
+            state->total_wait_us += waited_us;
+            state->max_wait_us = std::max(state->max_wait_us, waited_us);
+            
+            // Others may now be first in line for a remaining slot
+            pthread_cond_broadcast(&state->changed);
+            pthread_mutex_unlock(&state->mutex);
+            return;
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            *self = Waiter{};
+            state->timed_out++;
+            pthread_cond_broadcast(&state->changed);
+            pthread_mutex_unlock(&state->mutex);
+            throw AdmissionError("Timed out waiting for an inference slot");
+        }
+        
+        // Wake periodically to reclaim slots of processes that died without releasing
+        timespec until = monotonicAfter(std::min<std::chrono::steady_clock::duration>(deadline - now, kReapInterval));
+        int rc = pthread_cond_timedwait(&state->changed, &state->mutex, &until);
+        if (rc == EOWNERDEAD) {
+            pthread_mutex_consistent(&state->mutex);
+        }
+        reap(state);
+    }
+}
+
+AdmissionControl::Slot::~Slot() {
+    if (ticket == 0 || !shared) {
+        return;
+    }
+    
+    try {
+        lockState(shared);
+    } catch (const std::exception&) {
+        return; // The slot is reclaimed once this process exits
+    }
+    for (auto& holder : shared->holders) {
+        if (holder.ticket == ticket) {
+            holder = Holder{};
+            break;
+        }
+    }
+    pthread_cond_broadcast(&shared->changed);
+    pthread_mutex_unlock(&shared->mutex);
+}
+
+void AdmissionControl::configure(const Config& new_config) {
+    std::lock_guard<std::mutex> lock(config_mutex);
+    config = new_config;
+}
+
+AdmissionControl::Config AdmissionControl::getConfig() {
+    std::lock_guard<std::mutex> lock(config_mutex);
+    return config;
+}
+
+AdmissionControl::Stats AdmissionControl::getStats() {
+    SharedState* state;
+    {
+        std::lock_guard<std::mutex> lock(config_mutex);
+        state = openShared();
+    }
+    
+    Stats stats;
+    lockState(state);
+    reap(state);
+    stats.max_concurrent = state->max_concurrent;
+    stats.running = countRunning(state);
+    for (const auto& waiter : state->waiters) {
+        if (waiter.pid != 0) {
+            stats.waiting++;
+            stats.waiting_by_priority[std::max(0, std::min(2, static_cast<int>(waiter.priority)))]++;
+        }
+    }
+    stats.admitted = state->admitted;
+    stats.rejected = state->rejected;
+    stats.timed_out = state->timed_out;
+    stats.avg_wait_ms = state->admitted > 0 ? state->total_wait_us / 1000.0 / state->admitted : 0.0;
+    stats.max_wait_ms = state->max_wait_us / 1000.0;
+    pthread_mutex_unlock(&state->mutex);
+    
+    return stats;
+}
+
+AdmissionPriority AdmissionControl::parsePriority(const std::string& name) {
+    if (name == "high") {
+        return AdmissionPriority::HIGH;
+    }
+    if (name == "normal" || name.empty()) {
+        return AdmissionPriority::NORMAL;
+    }
+    if (name == "low") {
+        return AdmissionPriority::LOW;
+    }
+    throw std::runtime_error("Unknown priority '" + name + "' (expected high, normal or low)");
+}
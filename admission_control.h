@@ -0,0 +1,75 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+/**
+ * Raised when an inference is not admitted (queue full, fast-fail or queue timeout)
+ */
+class AdmissionError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+enum class AdmissionPriority {
+    LOW = 0,
+    NORMAL = 1,
+    HIGH = 2
+};
+
+/**
+ * Host-wide admission control for inferences
+ *
+ * A counting semaphore in POSIX shared memory bounds how many inferences run at
+ * once across every process on the host (e.g. all FPM workers). Waiters are
+ * admitted highest priority first, then first come first served. Slots held by
+ * processes that died are reclaimed, so a killed worker cannot leak capacity.
+ */
+class AdmissionControl {
+public:
+    struct Config {
+        int max_concurrent = 0;   // Host-wide limit, 0 = admission control off
+        int queue_limit = 0;      // Waiters allowed before new arrivals are rejected, 0 = unbounded
+        bool fast_fail = false;   // Reject instead of queueing when no slot is free
+    };
+    
+    struct Stats {
+        int max_concurrent = 0;
+        int running = 0;
+        int waiting = 0;
+        int waiting_by_priority[3] = {0, 0, 0}; // Indexed by AdmissionPriority
+        uint64_t admitted = 0;
+        uint64_t rejected = 0;
+        uint64_t timed_out = 0;
+        double avg_wait_ms = 0.0;
+        double max_wait_ms = 0.0;
+    };
+    
+    /**
+     * RAII admission: the constructor blocks until admitted (or throws AdmissionError),
+     * the destructor frees the slot. A no-op while admission control is off.
+     */
+    class Slot {
+    public:
+        Slot(AdmissionPriority priority, std::chrono::steady_clock::time_point deadline);
+        ~Slot();
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+        
+        double getWaitMs() const { return wait_ms; }
+        
+    private:
+        uint64_t ticket = 0; // 0 = not holding a slot
+        double wait_ms = 0.0;
+    };
+    
+    static void configure(const Config& config);
+    static Config getConfig();
+    static Stats getStats(); // Throws if the shared segment cannot be opened
+    static AdmissionPriority parsePriority(const std::string& name);
+};
+
+#endif
@@ -0,0 +1,432 @@
+/**
+ * phllama-batch - offline batch generation over a JSONL prompt file
+ *
+ * Each input line is a JSON object: {"prompt": "...", "max_tokens": 256, "temperature": 0.2,
+ * "seed": 42, "id": <any>}. Only "prompt" is required. Every result is written as one JSON line
+ * carrying the input's 0-based line index (and "id" when given) as soon as it is final, so the
+ * output file doubles as the checkpoint: --resume skips every index already present.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <set>
+#include <filesystem>
+#include <chrono>
+#include <csignal>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <getopt.h>
+#include "llama_interface.h"
+#include "ollama_interface.h"
+#include "json_util.h"
+
+namespace {
+    volatile std::sig_atomic_t interrupted = 0;
+    
+    void onInterrupt(int) {
+        interrupted = 1;
+        std::signal(SIGINT, SIG_DFL); // A second Ctrl-C exits immediately
+    }
+    
+    struct Options {
+        std::string model;
+        std::string input;
+        std::string output;
+        int parallel = 4;
+        int context_size = 0;  // 0 = 2048 per parallel sequence
+        int batch_size = 512;
+        int threads = -1;
+        int gpu_layers = -1;
+        int max_tokens = 512;
+        float temperature = -1.0f;
+        int64_t seed = -1;
+        bool input_order = true;
+        bool resume = false;
+    };
+    
+    void usage(const char* program) {
+        std::cerr << "Usage: " << program << " --model <name|file.gguf> --input <prompts.jsonl> --output <results.jsonl> [options]\n"
+                  << "\n"
+                  << "  -m, --model NAME        ollama model name or GGUF file path\n"
+                  << "  -i, --input FILE        JSONL prompts, one {\"prompt\": ...} object per line\n"
+                  << "  -o, --output FILE       JSONL results, appended to as each request finishes\n"
+                  << "  -p, --parallel N        sequences decoded together (default 4, max 16)\n"
+                  << "  -c, --ctx-size N        KV cache size shared by all sequences (default 2048 * parallel)\n"
+                  << "  -b, --batch-size N      tokens per llama_decode call (default 512)\n"
+                  << "  -t, --threads N         CPU threads (default auto)\n"
+                  << "  -g, --gpu-layers N      layers to offload (default auto)\n"
+                  << "  -n, --max-tokens N      default max_tokens per prompt (default 512)\n"
+                  << "      --temperature T     default temperature (default 0.7)\n"
+                  << "      --seed N            default sampling seed (default random)\n"
+                  << "      --order input|completion\n"
+                  << "                          write results in input order (default) or as they finish\n"
+                  << "      --resume            skip prompts already present in the output file\n";
+    }
+    
+    int64_t parseInt64(const char* value, const char* name) {
+        char* end = nullptr;
+        errno = 0;
+        long long parsed = std::strtoll(value, &end, 10);
+        if (end == value || *end != '\0' || errno == ERANGE) {
+            throw std::runtime_error(std::string("Invalid value for --") + name + ": " + value);
+        }
+        return static_cast<int64_t>(parsed);
+    }
+    
+    int parseInt(const char* value, const char* name) {
+        int64_t parsed = parseInt64(value, name);
+        if (parsed < INT_MIN || parsed > INT_MAX) {
+            throw std::runtime_error(std::string("Invalid value for --") + name + ": " + value);
+        }
+        return static_cast<int>(parsed);
+    }
+    
+    float parseFloat(const char* value, const char* name) {
+        char* end = nullptr;
+        errno = 0;
+        float parsed = std::strtof(value, &end);
+        if (end == value || *end != '\0' || errno == ERANGE || !std::isfinite(parsed)) {
+            throw std::runtime_error(std::string("Invalid value for --") + name + ": " + value);
+        }
+        return parsed;
+    }
+    
+    /**
+     * Read an optional numeric field of an input line, within the same bounds as its flag
+     */
+    double numberField(const JsonValue& line, const char* name, double min, double max, bool integral) {
+        const JsonValue* value = line.get(name);
+        if (value->type != JsonValue::Type::NUMBER || !std::isfinite(value->number) ||
+            value->number < min || value->number > max || (integral && std::trunc(value->number) != value->number)) {
+            std::ostringstream message;
+            message << "\"" << name << "\" must be ";
+            if (integral) {
+                message << "an integer between " << static_cast<long long>(min) << " and " << static_cast<long long>(max);
+            } else {
+                message << "a number between " << min << " and " << max;
+            }
+            throw std::runtime_error(message.str());
+        }
+        return value->number;
+    }
+    
+    Options parseOptions(int argc, char** argv) {
+        static const option long_options[] = {
+            {"model", required_argument, nullptr, 'm'},
+            {"input", required_argument, nullptr, 'i'},
+            {"output", required_argument, nullptr, 'o'},
+            {"parallel", required_argument, nullptr, 'p'},
+            {"ctx-size", required_argument, nullptr, 'c'},
+            {"batch-size", required_argument, nullptr, 'b'},
+            {"threads", required_argument, nullptr, 't'},
+            {"gpu-layers", required_argument, nullptr, 'g'},
+            {"max-tokens", required_argument, nullptr, 'n'},
+            {"temperature", required_argument, nullptr, 'T'},
+            {"seed", required_argument, nullptr, 'S'},
+            {"order", required_argument, nullptr, 'O'},
+            {"resume", no_argument, nullptr, 'r'},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, 0, nullptr, 0}
+        };
+        
+        Options options;
+        int opt;
+        while ((opt = getopt_long(argc, argv, "m:i:o:p:c:b:t:g:n:h", long_options, nullptr)) != -1) {
+            switch (opt) {
+                case 'm': options.model = optarg; break;
+                case 'i': options.input = optarg; break;
+                case 'o': options.output = optarg; break;
+                case 'p': options.parallel = parseInt(optarg, "parallel"); break;
+                case 'c': options.context_size = parseInt(optarg, "ctx-size"); break;
+                case 'b': options.batch_size = parseInt(optarg, "batch-size"); break;
+                case 't': options.threads = parseInt(optarg, "threads"); break;
+                case 'g': options.gpu_layers = parseInt(optarg, "gpu-layers"); break;
+                case 'n': options.max_tokens = parseInt(optarg, "max-tokens"); break;
+                case 'T': options.temperature = parseFloat(optarg, "temperature"); break;
+                case 'S': options.seed = parseInt64(optarg, "seed"); break;
+                case 'O':
+                    if (std::string(optarg) == "input") {
+                        options.input_order = true;
+                    } else if (std::string(optarg) == "completion") {
+                        options.input_order = false;
+                    } else {
+                        throw std::runtime_error("--order must be 'input' or 'completion'");
+                    }
+                    break;
+                case 'r': options.resume = true; break;
+                case 'h': usage(argv[0]); std::exit(0);
+                default: usage(argv[0]); std::exit(2);
+            }
+        }
+        
+        if (options.model.empty() || options.input.empty() || options.output.empty()) {
+            usage(argv[0]);
+            std::exit(2);
+        }
+        if (options.parallel < 1 || options.parallel > 16) {
+            throw std::runtime_error("--parallel must be between 1 and 16");
+        }
+        if (options.max_tokens < 1) {
+            throw std::runtime_error("--max-tokens must be positive");
+        }
+        if (options.temperature != -1.0f && (options.temperature < 0.0f || options.temperature > 2.0f)) {
+            throw std::runtime_error("--temperature must be between 0.0 and 2.0");
+        }
+        if (options.seed != -1 && (options.seed < 0 || options.seed > UINT32_MAX)) {
+            throw std::runtime_error("--seed must be between 0 and " + std::to_string(UINT32_MAX));
+        }
+        if (options.gpu_layers < -1) {
+            throw std::runtime_error("--gpu-layers must be -1 (auto) or a layer count");
+        }
+        if (options.context_size <= 0) {
+            options.context_size = 2048 * options.parallel;
+        }
+        options.batch_size = std::max(options.batch_size, options.parallel);
+        
+        return options;
+    }
+    
+    /**
+     * Collect the indices already in the output file and drop a partially written last line
+     */
+    std::set<size_t> loadCheckpoint(const std::string& path) {
+        std::set<size_t> completed;
+        if (!std::filesystem::exists(path)) {
+            return completed;
+        }
+        
+        std::ifstream file(path, std::ios::binary);
+        std::string line;
+        std::uintmax_t valid_bytes = 0;
+        std::uintmax_t offset = 0;
+        while (std::getline(file, line)) {
+            offset += line.size();
+            if (file.eof()) {
+                break; // No trailing newline: interrupted mid-write
+            }
+            offset += 1;
+            try {
+                JsonValue value = JsonValue::parse(line);
+                const JsonValue* index = value.get("index");
+                if (index && index->type == JsonValue::Type::NUMBER) {
+                    completed.insert(static_cast<size_t>(index->number));
+                    valid_bytes = offset;
+                }
+            } catch (const std::exception&) {
+                break;
+            }
+        }
+        file.close();
+        
+        if (valid_bytes != std::filesystem::file_size(path)) {
+            std::filesystem::resize_file(path, valid_bytes);
+        }
+        return completed;
+    }
+    
+    /**
+     * Appends result lines, holding back out-of-order results in input-order mode
+     * A running request generates at most max_tokens steps while others finish, so the
+     * reorder buffer stays bounded by parallel * max_tokens however large the input is
+     */
+    class ResultWriter {
+    public:
+        ResultWriter(const std::string& path, bool input_order, const std::set<size_t>& completed)
+            : out(path, std::ios::app | std::ios::binary), input_order(input_order), completed(completed) {
+            if (!out) {
+                throw std::runtime_error("Cannot open output file: " + path);
+            }
+            advance();
+        }
+        
+        void write(size_t index, const std::string& line) {
+            written++;
+            if (!input_order) {
+                emit(line);
+                return;
+            }
+            pending[index] = line;
+            advance();
+        }
+        
+        size_t getWritten() const { return written; }
+    
+    private:
+        std::ofstream out;
+        bool input_order;
+        std::set<size_t> completed;
+        std::map<size_t, std::string> pending;
+        size_t next_index = 0;
+        size_t written = 0;
+        
+        void emit(const std::string& line) {
+            out << line << '\n';
+            out.flush();
+        }
+        
+        void advance() {
+            while (true) {
+                auto it = pending.find(next_index);
+                if (it != pending.end()) {
+                    emit(it->second);
+                    pending.erase(it);
+                } else if (!completed.count(next_index)) {
+                    break;
+                }
+                next_index++;
+            }
+        }
+    };
+    
+    std::string formatResult(const BatchResult& result, const std::string& id_json) {
+        std::string line = "{\"index\":" + std::to_string(result.index);
+        if (!id_json.empty()) {
+            line += ",\"id\":" + id_json;
+        }
+        if (!result.error.empty()) {
+            line += ",\"error\":" + jsonEscape(result.error);
+        } else {
+            line += ",\"text\":" + jsonEscape(result.text) +
+                    ",\"stop_reason\":" + jsonEscape(result.stop_reason);
+        }
+        line += ",\"prompt_tokens\":" + std::to_string(result.prompt_tokens) +
+                ",\"generated_tokens\":" + std::to_string(result.generated_tokens) + "}";
+        return line;
+    }
+    
+    std::string resolveModelPath(const std::string& model) {
+        if (model.find('/') != std::string::npos || model.find(".gguf") != std::string::npos) {
+            return model;
+        }
+        return OllamaInterface::getModelPath(model);
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        Options options = parseOptions(argc, argv);
+        
+        std::ifstream input(options.input);
+        if (!input) {
+            throw std::runtime_error("Cannot open input file: " + options.input);
+        }
+        
+        std::set<size_t> completed;
+        if (options.resume) {
+            completed = loadCheckpoint(options.output);
+        } else if (std::filesystem::exists(options.output) && std::filesystem::file_size(options.output) > 0) {
+            throw std::runtime_error("Output file already exists; pass --resume to continue it");
+        }
+        ResultWriter writer(options.output, options.input_order, completed);
+        
+        HardwareConfig config;
+        config.cpu_threads = options.threads;
+        config.gpu_layers = options.gpu_layers;
+        if (options.gpu_layers >= 0) {
+            // AUTO would replace the layer count with the detected optimum
+            config.gpu_mode = options.gpu_layers == 0 ? GPUMode::CPU_ONLY : GPUMode::SINGLE_GPU;
+        }
+        config.context_size = options.context_size;
+        config.batch_size = options.batch_size;
+        
+        LlamaInterface engine;
+        std::string model_path = resolveModelPath(options.model);
+        std::cerr << "Loading " << model_path << "..." << std::endl;
+        if (!engine.loadModel(model_path, config)) {
+            throw std::runtime_error("Failed to load model " + model_path);
+        }
+        if (options.temperature >= 0.0f) {
+            engine.setTemperature(options.temperature);
+        }
+        if (options.seed >= 0) {
+            engine.setSeed(static_cast<uint32_t>(options.seed));
+        }
+        
+        std::signal(SIGINT, onInterrupt);
+        
+        std::map<size_t, std::string> ids; // Echoed "id" of requests in flight
+        size_t line_number = 0;
+        size_t generated_tokens = 0;
+        auto start_time = std::chrono::steady_clock::now();
+        
+        auto report = [&]() {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            std::cerr << "\r" << writer.getWritten() << " done, " << generated_tokens << " tokens, "
+                      << static_cast<int>(generated_tokens / std::max(seconds, 1e-3)) << " tok/s" << std::flush;
+        };
+        
+        // Pull the next runnable prompt; malformed lines are answered immediately
+        auto next = [&](BatchRequest& request) {
+            std::string line;
+            while (!interrupted && std::getline(input, line)) {
+                if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                    continue;
+                }
+                size_t index = line_number++;
+                if (completed.count(index)) {
+                    continue;
+                }
+                
+                BatchResult rejected;
+                rejected.index = index;
+                try {
+                    JsonValue value = JsonValue::parse(line);
+                    const JsonValue* prompt = value.get("prompt");
+                    if (!prompt || prompt->type != JsonValue::Type::STRING) {
+                        throw std::runtime_error("Missing string field \"prompt\"");
+                    }
+                    
+                    request = BatchRequest();
+                    request.index = index;
+                    request.prompt = prompt->string;
+                    request.max_tokens = options.max_tokens;
+                    if (value.get("max_tokens")) {
+                        request.max_tokens = static_cast<int>(numberField(value, "max_tokens", 1, INT_MAX, true));
+                    }
+                    if (value.get("temperature")) {
+                        request.temperature = static_cast<float>(numberField(value, "temperature", 0.0, 2.0, false));
+                    }
+                    if (value.get("seed")) {
+                        request.seed = static_cast<int64_t>(numberField(value, "seed", 0, UINT32_MAX, true));
+                    }
+                    if (const JsonValue* v = value.get("id")) {
+                        ids[index] = v->dump();
+                    }
+                    return true;
+                } catch (const std::exception& e) {
+                    rejected.error = std::string("Invalid input line: ") + e.what();
+                }
+                writer.write(index, formatResult(rejected, ""));
+            }
+            return false;
+        };
+        
+        auto done = [&](const BatchResult& result) {
+            auto id = ids.find(result.index);
+            writer.write(result.index, formatResult(result, id != ids.end() ? id->second : ""));
+            if (id != ids.end()) {
+                ids.erase(id);
+            }
+            generated_tokens += result.generated_tokens;
+            report();
+        };
+        
+        engine.generateBatch(options.parallel, next, done);
+        report();
+        std::cerr << std::endl;
+        
+        if (interrupted) {
+            std::cerr << "Interrupted; rerun with --resume to continue" << std::endl;
+            return 130;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "phllama-batch: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,226 @@
+#include "context_pool.h"
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <malloc.h>
+
+namespace {
+    struct PoolEntry {
+        std::string key;
+        const LlamaModel* model = nullptr;
+        std::shared_ptr<LlamaContext> context;
+        uint64_t generations = 0;
+        std::chrono::steady_clock::time_point returned;
+    };
+    
+    /**
+     * Contexts are always freed under the mutex, so releaseModel() cannot return while
+     * one of the model's contexts is still being freed on another thread
+     *
+     * Pool state is never destroyed: models freed during static destruction still
+     * release their contexts through it
+     */
+    struct PoolState {
+        std::mutex mutex;
+        std::condition_variable wake; // Signals the sweeper when the pool or timeout changes
+        std::list<PoolEntry> idle;    // Most recently returned at the front
+        ContextPool::Config config;
+        ContextPool::Stats stats;
+        std::thread sweeper;
+        bool stopping = false;        // Set by shutdown(); the sweeper exits and is not restarted
+    };
+    
+    PoolState& state() {
+        static PoolState* pool = new PoolState();
+        return *pool;
+    }
+    
+    /**
+     * Free idle contexts that outlived the timeout, then sleep until the next one expires
+     * Freed KV buffers are handed back to the OS with malloc_trim so idle workers shrink
+     */
+    void sweep() {
+        PoolState& pool = state();
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        while (!pool.stopping) {
+            auto now = std::chrono::steady_clock::now();
+            auto timeout = std::chrono::milliseconds(pool.config.idle_timeout_ms);
+            auto next = std::chrono::steady_clock::time_point::max();
+            size_t expired = 0;
+            
+            if (pool.config.idle_timeout_ms > 0) {
+                for (auto it = pool.idle.begin(); it != pool.idle.end();) {
+                    if (now - it->returned >= timeout) {
+                        it = pool.idle.erase(it);
+                        expired++;
+                    } else {
+                        next = std::min(next, it->returned + timeout);
+                        ++it;
+                    }
+                }
+            }
+            
+            if (expired > 0) {
+                pool.stats.released += expired;
+                malloc_trim(0);
+            }
+            
+            if (next == std::chrono::steady_clock::time_point::max()) {
+                pool.wake.wait(lock);
+            } else {
+                pool.wake.wait_until(lock, next);
+            }
+        }
+    }
+    
+    /**
+     * Start the sweeper on first use; caller must hold the pool mutex
+     */
+    void startSweeper(PoolState& pool) {
+        if (!pool.sweeper.joinable() && !pool.stopping && pool.config.max_idle > 0 &&
+            pool.config.idle_timeout_ms > 0) {
+            pool.sweeper = std::thread(sweep);
+        }
+    }
+}
+
+std::shared_ptr<LlamaContext> ContextPool::checkout(const std::string& key, const LlamaModel* model) {
+    PoolState& pool = state();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    
+    for (auto it = pool.idle.begin(); it != pool.idle.end(); ++it) {
+        if (it->key == key && it->model == model) {
+            std::shared_ptr<LlamaContext> context = std::move(it->context);
+            pool.idle.erase(it);
+            pool.stats.reused++;
+            return context;
+        }
+    }
+    
+    pool.stats.created++;
+    return nullptr;
+}
+
+void ContextPool::checkin(const std::string& key, const LlamaModel* model,
+                          std::shared_ptr<LlamaContext> context, uint64_t generations) {
+    PoolState& pool = state();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    
+    if (pool.config.max_idle == 0 || pool.stopping) {
+        context.reset();
+        pool.stats.released++;
+        return;
+    }
+    
+    PoolEntry entry;
+    entry.key = key;
+    entry.model = model;
+    entry.context = std::move(context);
+    entry.generations = generations;
+    entry.returned = std::chrono::steady_clock::now();
+    pool.idle.push_front(std::move(entry));
+    
+    // Over the limit: free the least recently returned
+    while (pool.idle.size() > pool.config.max_idle) {
+        pool.idle.pop_back();
+        pool.stats.released++;
+    }
+    
+    startSweeper(pool);
+    pool.wake.notify_one();
+}
+
+void ContextPool::releaseModel(const LlamaModel* model) {
+    PoolState& pool = state();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    
+    for (auto it = pool.idle.begin(); it != pool.idle.end();) {
+        if (it->model == model) {
+            it = pool.idle.erase(it);
+            pool.stats.released++;
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ContextPool::releaseIdle() {
+    PoolState& pool = state();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    
+    size_t count = pool.idle.size();
+    pool.idle.clear();
+    pool.stats.released += count;
+    if (count > 0) {
+        malloc_trim(0);
+    }
+    return count;
+}
+
+void ContextPool::configure(const Config& config) {
+    PoolState& pool = state();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    pool.config = config;
+    
+    while (pool.idle.size() > pool.config.max_idle) {
+        pool.idle.pop_back();
+        pool.stats.released++;
+    }
+    
+    startSweeper(pool);
+    pool.wake.notify_one(); // Re-evaluate expiry under the new timeout
+}
+
+/**
+ * Stop and join the sweeper and free every idle context
+ * Must run before the extension is unloaded, while the sweeper's code is still mapped
+ */
+void ContextPool::shutdown() {
+    PoolState& pool = state();
+    std::thread sweeper;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stopping = true;
+        pool.stats.released += pool.idle.size();
+        pool.idle.clear();
+        sweeper = std::move(pool.sweeper);
+    }
+    pool.wake.notify_one();
+    if (sweeper.joinable()) {
+        sweeper.join();
+    }
+}
+
+ContextPool::Config ContextPool::getConfig() {
+    PoolState& pool = state();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pool.config;
+}
+
+ContextPool::Stats ContextPool::getStats() {
+    PoolState& pool = state();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    Stats stats = pool.stats;
+    stats.idle = pool.idle.size();
+    return stats;
+}
+
+std::vector<ContextPool::EntryInfo> ContextPool::getEntries() {
+    PoolState& pool = state();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    
+    std::vector<EntryInfo> entries;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& entry : pool.idle) {
+        EntryInfo info;
+        info.key = entry.key;
+        info.generations = entry.generations;
+        info.idle_seconds = std::chrono::duration<double>(now - entry.returned).count();
+        entries.push_back(info);
+    }
+    
+    return entries;
+}
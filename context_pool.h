@@ -0,0 +1,66 @@
+#ifndef CONTEXT_POOL_H
+#define CONTEXT_POOL_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+struct LlamaContext;
+struct LlamaModel;
+
+/**
+ * Process-level pool of idle llama contexts
+ *
+ * Creating a context allocates its KV cache and reserves compute graphs, so
+ * instead of freeing it, a LlamaInterface returns its context here and the next
+ * instance with the same model and context parameters checks it out again.
+ * Pooled contexts are bound to one model instance: they only outlive a request
+ * when the model itself stays resident (see ModelCache), and are freed with it.
+ * Idle contexts are freed after a timeout so idle workers give their KV memory back.
+ */
+class ContextPool {
+public:
+    enum class ResetPolicy {
+        CLEAR = 0,    // Clear the KV cache on return; nothing leaks between requests
+        PRESERVE = 1  // Keep the KV cache so the next user can reuse a common prompt prefix
+    };
+    
+    struct Config {
+        size_t max_idle = 0;             // Idle contexts kept per process, 0 = pooling off
+        int64_t idle_timeout_ms = 60000; // Idle contexts are freed after this long, 0 = never
+        ResetPolicy reset = ResetPolicy::CLEAR;
+    };
+    
+    struct EntryInfo {
+        std::string key;
+        uint64_t generations = 0;
+        double idle_seconds = 0.0;
+    };
+    
+    struct Stats {
+        size_t idle = 0;
+        uint64_t created = 0;  // Contexts created because none could be reused
+        uint64_t reused = 0;
+        uint64_t released = 0; // Freed on timeout, overflow or with their model
+    };
+    
+    // Idle context created from `model` with parameters `key`, or nullptr (counted as a creation)
+    static std::shared_ptr<LlamaContext> checkout(const std::string& key, const LlamaModel* model);
+    
+    // Return a context; it is freed instead when pooling is off or the pool is full
+    static void checkin(const std::string& key, const LlamaModel* model,
+                        std::shared_ptr<LlamaContext> context, uint64_t generations);
+    
+    static void releaseModel(const LlamaModel* model); // Must run before the model is freed
+    static size_t releaseIdle(); // Frees every idle context, returns the number freed
+    static void shutdown();      // Joins the sweeper thread; pooling stops for good
+    
+    static void configure(const Config& config);
+    static Config getConfig();
+    static Stats getStats();
+    static std::vector<EntryInfo> getEntries();
+};
+
+#endif
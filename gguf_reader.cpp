@@ -0,0 +1,282 @@
+#include "gguf_reader.h"
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    enum GGUFType : uint32_t {
+        GGUF_UINT8 = 0, GGUF_INT8 = 1, GGUF_UINT16 = 2, GGUF_INT16 = 3,
+        GGUF_UINT32 = 4, GGUF_INT32 = 5, GGUF_FLOAT32 = 6, GGUF_BOOL = 7,
+        GGUF_STRING = 8, GGUF_ARRAY = 9, GGUF_UINT64 = 10, GGUF_INT64 = 11,
+        GGUF_FLOAT64 = 12
+    };
+    
+    // llama_ftype values as stored in general.file_type
+    const std::map<uint32_t, const char*> file_types = {
+        {0, "F32"}, {1, "F16"}, {2, "Q4_0"}, {3, "Q4_1"}, {7, "Q8_0"}, {8, "Q5_0"},
+        {9, "Q5_1"}, {10, "Q2_K"}, {11, "Q3_K_S"}, {12, "Q3_K_M"}, {13, "Q3_K_L"},
+        {14, "Q4_K_S"}, {15, "Q4_K_M"}, {16, "Q5_K_S"}, {17, "Q5_K_M"}, {18, "Q6_K"},
+        {19, "IQ2_XXS"}, {20, "IQ2_XS"}, {21, "Q2_K_S"}, {22, "IQ3_XS"}, {23, "IQ3_XXS"},
+        {24, "IQ1_S"}, {25, "IQ4_NL"}, {26, "IQ3_S"}, {27, "IQ3_M"}, {28, "IQ2_S"},
+        {29, "IQ2_M"}, {30, "IQ4_XS"}, {31, "IQ1_M"}, {32, "BF16"}, {36, "TQ1_0"},
+        {37, "TQ2_0"}
+    };
+    
+    // ggml_type names, used when general.file_type is missing
+    const std::map<uint32_t, const char*> tensor_types = {
+        {0, "F32"}, {1, "F16"}, {2, "Q4_0"}, {3, "Q4_1"}, {6, "Q5_0"}, {7, "Q5_1"},
+        {8, "Q8_0"}, {9, "Q8_1"}, {10, "Q2_K"}, {11, "Q3_K"}, {12, "Q4_K"}, {13, "Q5_K"},
+        {14, "Q6_K"}, {15, "Q8_K"}, {16, "IQ2_XXS"}, {17, "IQ2_XS"}, {18, "IQ3_XXS"},
+        {19, "IQ1_S"}, {20, "IQ4_NL"}, {21, "IQ3_S"}, {22, "IQ2_S"}, {23, "IQ4_XS"},
+        {29, "IQ1_M"}, {30, "BF16"}, {34, "TQ1_0"}, {35, "TQ2_0"}
+    };
+    
+    struct CachedInfo {
+        int64_t mtime = 0;
+        uint64_t size = 0;
+        GGUFInfo info;
+    };
+    
+    std::unordered_map<std::string, CachedInfo> info_cache;
+    std::mutex info_cache_mutex;
+    
+    /**
+     * Bounds-checked cursor over the mapped header
+     */
+    class Cursor {
+    public:
+        Cursor(const uint8_t* data, size_t size) : data(data), size(size) {}
+        
+        template <typename T>
+        T read() {
+            require(sizeof(T));
+            T value;
+            std::memcpy(&value, data + offset, sizeof(T));
+            offset += sizeof(T);
+            return value;
+        }
+        
+        std::string readString() {
+            uint64_t length = read<uint64_t>();
+            require(length);
+            std::string value(reinterpret_cast<const char*>(data + offset), length);
+            offset += length;
+            return value;
+        }
+        
+        void skipString() {
+            uint64_t length = read<uint64_t>();
+            require(length);
+            offset += length;
+        }
+        
+        void skipValue(uint32_t type) {
+            switch (type) {
+                case GGUF_UINT8: case GGUF_INT8: case GGUF_BOOL: skip(1); break;
+                case GGUF_UINT16: case GGUF_INT16: skip(2); break;
+                case GGUF_UINT32: case GGUF_INT32: case GGUF_FLOAT32: skip(4); break;
+                case GGUF_UINT64: case GGUF_INT64: case GGUF_FLOAT64: skip(8); break;
+                case GGUF_STRING: skipString(); break;
+                case GGUF_ARRAY: {
+                    uint32_t element_type = read<uint32_t>();
+                    uint64_t count = read<uint64_t>();
+                    for (uint64_t i = 0; i < count; i++) {
+                        skipValue(element_type);
+                    }
+                    break;
+                }
+                default:
+                    throw std::runtime_error("Unknown GGUF value type " + std::to_string(type));
+            }
+        }
+        
+        // Integer metadata may be stored with any integer width
+        int64_t readInteger(uint32_t type) {
+            switch (type) {
+                case GGUF_UINT8: return read<uint8_t>();
+                case GGUF_INT8: return read<int8_t>();
+                case GGUF_UINT16: return read<uint16_t>();
+                case GGUF_INT16: return read<int16_t>();
+                case GGUF_UINT32: return read<uint32_t>();
+                case GGUF_INT32: return read<int32_t>();
+                case GGUF_UINT64: return static_cast<int64_t>(read<uint64_t>());
+                case GGUF_INT64: return read<int64_t>();
+                default:
+                    skipValue(type);
+                    return 0;
+            }
+        }
+        
+    private:
+        const uint8_t* data;
+        size_t size;
+        size_t offset = 0;
+        
+        void require(uint64_t bytes) {
+            if (bytes > size - offset) {
+                throw std::runtime_error("Truncated GGUF header");
+            }
+        }
+        
+        void skip(uint64_t bytes) {
+            require(bytes);
+            offset += bytes;
+        }
+    };
+    
+    bool endsWith(const std::string& value, const std::string& suffix) {
+        return value.size() >= suffix.size() &&
+            value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+    
+    GGUFInfo parse(const std::string& path, const uint8_t* data, size_t size) {
+        GGUFInfo info;
+        info.path = path;
+        info.file_size = size;
+        
+        Cursor cursor(data, size);
+        if (cursor.read<uint32_t>() != 0x46554747) { // "GGUF" little-endian
+            throw std::runtime_error("Not a GGUF file: " + path);
+        }
+        
+        info.version = cursor.read<uint32_t>();
+        if (info.version < 2) {
+            throw std::runtime_error("Unsupported GGUF version " + std::to_string(info.version));
+        }
+        
+        info.tensor_count = cursor.read<uint64_t>();
+        uint64_t kv_count = cursor.read<uint64_t>();
+        
+        // Architecture-specific keys ("llama.context_length") are matched by suffix,
+        // since general.architecture is not guaranteed to come first
+        int64_t file_type = -1;
+        for (uint64_t i = 0; i < kv_count; i++) {
+            std::string key = cursor.readString();
+            uint32_t type = cursor.read<uint32_t>();
+            
+            if (key == "general.architecture" && type == GGUF_STRING) {
+                info.architecture = cursor.readString();
+            } else if (key == "general.name" && type == GGUF_STRING) {
+                info.name = cursor.readString();
+            } else if (key == "general.file_type") {
+                file_type = cursor.readInteger(type);
+            } else if (key == "tokenizer.chat_template" && type == GGUF_STRING) {
+                info.chat_template = cursor.readString();
+            } else if (key == "tokenizer.ggml.tokens" && type == GGUF_ARRAY) {
+                uint32_t element_type = cursor.read<uint32_t>();
+                uint64_t count = cursor.read<uint64_t>();
+                info.vocab_size = static_cast<int64_t>(count);
+                for (uint64_t j = 0; j < count; j++) {
+                    cursor.skipValue(element_type);
+                }
+            } else if (endsWith(key, ".context_length")) {
+                info.context_length = cursor.readInteger(type);
+            } else if (endsWith(key, ".embedding_length")) {
+                info.embedding_length = cursor.readInteger(type);
+            } else if (endsWith(key, ".block_count")) {
+                info.block_count = cursor.readInteger(type);
+            } else if (endsWith(key, ".attention.head_count") && type != GGUF_ARRAY) {
+                info.head_count = cursor.readInteger(type);
+            } else {
+                cursor.skipValue(type);
+            }
+        }
+        
+        // Tensor directory: parameter count and, as a fallback, the dominant tensor type
+        std::map<uint32_t, uint64_t> elements_by_type;
+        for (uint64_t i = 0; i < info.tensor_count; i++) {
+            cursor.skipString();
+            uint32_t n_dims = cursor.read<uint32_t>();
+            uint64_t elements = 1;
+            for (uint32_t d = 0; d < n_dims; d++) {
+                elements *= cursor.read<uint64_t>();
+            }
+            uint32_t tensor_type = cursor.read<uint32_t>();
+            cursor.read<uint64_t>(); // Data offset
+            
+            info.parameter_count += elements;
+            elements_by_type[tensor_type] += elements;
+        }
+        
+        auto named = file_types.find(static_cast<uint32_t>(file_type));
+        if (file_type >= 0 && named != file_types.end()) {
+            info.quantization = named->second;
+        } else if (!elements_by_type.empty()) {
+            auto dominant = elements_by_type.begin();
+            for (auto it = elements_by_type.begin(); it != elements_by_type.end(); ++it) {
+                if (it->second > dominant->second) {
+                    dominant = it;
+                }
+            }
+            auto type_name = tensor_types.find(dominant->first);
+            info.quantization = type_name != tensor_types.end() ? type_name->second : "unknown";
+        }
+        
+        return info;
+    }
+}
+
+/**
+ * Read a GGUF file's metadata, served from cache while the file is unchanged
+ */
+GGUFInfo GGUFReader::readInfo(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open model file: " + path);
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat model file: " + path);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(info_cache_mutex);
+        auto cached = info_cache.find(path);
+        if (cached != info_cache.end() && cached->second.mtime == st.st_mtime &&
+            cached->second.size == static_cast<uint64_t>(st.st_size)) {
+            close(fd);
+            return cached->second.info;
+        }
+    }
+    
+    // Only the header pages are ever touched, whatever the file size
+    size_t size = static_cast<size_t>(st.st_size);
+    void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Cannot map model file: " + path);
+    }
+    
+    GGUFInfo info;
+    try {
+        info = parse(path, static_cast<const uint8_t*>(mapping), size);
+    } catch (...) {
+        munmap(mapping, size);
+        throw;
+    }
+    munmap(mapping, size);
+    
+    std::lock_guard<std::mutex> lock(info_cache_mutex);
+    info_cache[path] = {static_cast<int64_t>(st.st_mtime), static_cast<uint64_t>(st.st_size), info};
+    return info;
+}
+
+bool GGUFReader::isGGUF(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    char magic[4];
+    bool is_gguf = read(fd, magic, sizeof(magic)) == sizeof(magic) && std::memcmp(magic, "GGUF", 4) == 0;
+    close(fd);
+    return is_gguf;
+}
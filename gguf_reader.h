@@ -0,0 +1,40 @@
+#ifndef GGUF_READER_H
+#define GGUF_READER_H
+
+#include <string>
+#include <cstdint>
+
+/**
+ * Model metadata read straight from a GGUF header
+ */
+struct GGUFInfo {
+    std::string path;
+    uint32_t version = 0;
+    std::string architecture;
+    std::string name;
+    std::string quantization;   // File type, e.g. "Q4_K_M"
+    std::string chat_template;
+    uint64_t file_size = 0;
+    uint64_t tensor_count = 0;
+    uint64_t parameter_count = 0;
+    int64_t context_length = 0; // Training context
+    int64_t embedding_length = 0;
+    int64_t block_count = 0;
+    int64_t head_count = 0;
+    int64_t vocab_size = 0;
+};
+
+/**
+ * Fast GGUF metadata reader
+ *
+ * Maps the file and walks only the key/value section and tensor directory, so
+ * metadata is available in microseconds without loading any weights. Results
+ * are cached per path and invalidated when the file's mtime or size changes.
+ */
+class GGUFReader {
+public:
+    static GGUFInfo readInfo(const std::string& path);
+    static bool isGGUF(const std::string& path); // Checks the magic bytes only
+};
+
+#endif
@@ -0,0 +1,596 @@
+#include "json_util.h"
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+namespace {
+    const int kMaxDepth = 64;
+    
+    void appendUtf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+    
+    class Parser {
+    public:
+        explicit Parser(const std::string& text) : text(text) {}
+        
+        JsonValue parseDocument() {
+            JsonValue value = parseValue(0);
+            skipWhitespace();
+            if (pos != text.size()) {
+                fail("Unexpected trailing characters");
+            }
+            return value;
+        }
+    
+    private:
+        const std::string& text;
+        size_t pos = 0;
+        
+        [[noreturn]] void fail(const std::string& message) {
+            throw std::runtime_error(message + " at offset " + std::to_string(pos));
+        }
+        
+        void skipWhitespace() {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+                pos++;
+            }
+        }
+        
+        bool consume(const char* literal) {
+            size_t length = std::char_traits<char>::length(literal);
+            if (text.compare(pos, length, literal) == 0) {
+                pos += length;
+                return true;
+            }
+            return false;
+        }
+        
+        JsonValue parseValue(int depth) {
+            if (depth > kMaxDepth) {
+                fail("JSON nested too deeply");
+            }
+            skipWhitespace();
+            if (pos >= text.size()) {
+                fail("Unexpected end of JSON");
+            }
+            
+            JsonValue value;
+            char c = text[pos];
+            if (c == '{') {
+                value.type = JsonValue::Type::OBJECT;
+                pos++;
+                skipWhitespace();
+                if (pos < text.size() && text[pos] == '}') {
+                    pos++;
+                    return value;
+                }
+                while (true) {
+                    skipWhitespace();
+                    if (pos >= text.size() || text[pos] != '"') {
+                        fail("Expected object key");
+                    }
+                    std::string key = parseString();
+                    skipWhitespace();
+                    if (pos >= text.size() || text[pos] != ':') {
+                        fail("Expected ':'");
+                    }
+                    pos++;
+                    value.members.emplace_back(std::move(key), parseValue(depth + 1));
+                    skipWhitespace();
+                    if (pos < text.size() && text[pos] == ',') {
+                        pos++;
+                    } else if (pos < text.size() && text[pos] == '}') {
+                        pos++;
+                        return value;
+                    } else {
+                        fail("Expected ',' or '}'");
+                    }
+                }
+            }
+            if (c == '[') {
+                value.type = JsonValue::Type::ARRAY;
+                pos++;
+                skipWhitespace();
+                if (pos < text.size() && text[pos] == ']') {
+                    pos++;
+                    return value;
+                }
+                while (true) {
+                    value.items.push_back(parseValue(depth + 1));
+                    skipWhitespace();
+                    if (pos < text.size() && text[pos] == ',') {
+                        pos++;
+                    } else if (pos < text.size() && text[pos] == ']') {
+                        pos++;
+                        return value;
+                    } else {
+                        fail("Expected ',' or ']'");
+                    }
+                }
+            }
+            if (c == '"') {
+                value.type = JsonValue::Type::STRING;
+                value.string = parseString();
+                return value;
+            }
+            if (consume("true")) {
+                value.type = JsonValue::Type::BOOL;
+                value.boolean = true;
+                return value;
+            }
+            if (consume("false")) {
+                value.type = JsonValue::Type::BOOL;
+                return value;
+            }
+            if (consume("null")) {
+                return value;
+            }
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                const char* start = text.c_str() + pos;
+                char* end = nullptr;
+                value.type = JsonValue::Type::NUMBER;
+                value.number = std::strtod(start, &end);
+                if (end == start) {
+                    fail("Malformed number");
+                }
+                pos += end - start;
+                return value;
+            }
+            fail("Unexpected character");
+        }
+        
+        unsigned parseHex4() {
+            if (pos + 4 > text.size()) {
+                fail("Truncated unicode escape");
+            }
+            unsigned code = 0;
+            for (int i = 0; i < 4; i++) {
+                char h = text[pos++];
+                code <<= 4;
+                if (h >= '0' && h <= '9') code |= h - '0';
+                else if (h >= 'a' && h <= 'f') code |= h - 'a' + 10;
+                else if (h >= 'A' && h <= 'F') code |= h - 'A' + 10;
+                else fail("Invalid unicode escape");
+            }
+            return code;
+        }
+        
+        std::string parseString() {
+            pos++; // Opening quote
+            std::string out;
+            while (true) {
+                if (pos >= text.size()) {
+                    fail("Unterminated string");
+                }
+                char c = text[pos++];
+                if (c == '"') {
+                    return out;
+                }
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                if (pos >= text.size()) {
+                    fail("Unterminated escape");
+                }
+                char e = text[pos++];
+                switch (e) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        unsigned code = parseHex4();
+                        // Surrogate pair
+                        if (code >= 0xD800 && code <= 0xDBFF && text.compare(pos, 2, "\\u") == 0) {
+                            pos += 2;
+                            unsigned low = parseHex4();
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUtf8(out, code);
+                        break;
+                    }
+                    default:
+                        fail("Invalid escape");
+                }
+            }
+        }
+    };
+}
+
+const JsonValue* JsonValue::get(const std::string& key) const {
+    if (type != Type::OBJECT) {
+        return nullptr;
+    }
+    for (const auto& member : members) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+std::string JsonValue::dump() const {
+    switch (type) {
+        case Type::NUL:
+            return "null";
+        case Type::BOOL:
+            return boolean ? "true" : "false";
+        case Type::NUMBER: {
+            if (!std::isfinite(number)) {
+                return "null";
+            }
+            char buffer[32];
+            if (number == std::floor(number) && std::fabs(number) < 1e15) {
+                std::snprintf(buffer, sizeof(buffer), "%.0f", number);
+            } else {
+                std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+            }
+            return buffer;
+        }
+        case Type::STRING:
+            return jsonEscape(string);
+        case Type::ARRAY: {
+            std::string out = "[";
+            for (size_t i = 0; i < items.size(); i++) {
+                if (i > 0) out += ",";
+                out += items[i].dump();
+            }
+            return out + "]";
+        }
+        case Type::OBJECT: {
+            std::string out = "{";
+            for (size_t i = 0; i < members.size(); i++) {
+                if (i > 0) out += ",";
+                out += jsonEscape(members[i].first) + ":" + members[i].second.dump();
+            }
+            return out + "}";
+        }
+    }
+    return "null";
+}
+
+JsonValue JsonValue::parse(const std::string& text) {
+    return Parser(text).parseDocument();
+}
+
+JsonStreamParser::JsonStreamParser(JsonHandler& handler) : handler(handler) {}
+
+/**
+ * Consume bytes until the top-level value closes; returns how many were consumed
+ * A malformed candidate is abandoned and scanning resumes right after its opening bracket
+ */
+size_t JsonStreamParser::feed(const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (state == State::DONE) {
+            return i;
+        }
+        
+        step(data[i]);
+        if (state == State::FAILED) {
+            restart();
+        }
+    }
+    return size;
+}
+
+/**
+ * A bracket in the leading prose ("see [1] below: {...}") turned out not to start the value:
+ * drop what the handler was given and rescan everything after that bracket
+ */
+void JsonStreamParser::restart() {
+    while (state == State::FAILED) {
+        std::string rescan = candidate.substr(1);
+        state = State::BEFORE;
+        stack.clear();
+        scalar.clear();
+        buffer.clear();
+        in_string = false;
+        escaped = false;
+        unicode_digits = -1;
+        high_surrogate = 0;
+        candidate.clear();
+        offset = candidate_offset + 1;
+        handler.reset();
+        
+        for (size_t i = 0; i < rescan.size() && state != State::FAILED && state != State::DONE; i++) {
+            step(rescan[i]);
+        }
+    }
+}
+
+void JsonStreamParser::step(char c) {
+    offset++;
+    if (state != State::BEFORE) {
+        candidate += c;
+    }
+    
+    if (in_string) {
+        stringChar(c);
+        return;
+    }
+    
+    // Literals and numbers end at the first character that cannot continue them
+    if (!scalar.empty()) {
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E') {
+            scalar += c;
+            return;
+        }
+        if (!endScalar()) {
+            return;
+        }
+    }
+    
+    if (state == State::BEFORE) {
+        if (c == '{' || c == '[') {
+            candidate.assign(1, c);
+            candidate_offset = offset - 1;
+            open(c);
+        }
+        return; // Anything before the value (prose, a code fence) is skipped
+    }
+    
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        return;
+    }
+    
+    switch (state) {
+        case State::FIRST_VALUE:
+            if (c == ']') {
+                close(c);
+                break;
+            }
+            // Fall through
+        case State::VALUE:
+            if (c == '{' || c == '[') {
+                open(c);
+            } else if (c == '"') {
+                in_string = true;
+                string_is_key = false;
+            } else if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+                scalar += c;
+            } else {
+                fail("Unexpected character", c);
+            }
+            break;
+        case State::FIRST_KEY:
+            if (c == '}') {
+                close(c);
+                break;
+            }
+            // Fall through
+        case State::KEY:
+            if (c == '"') {
+                in_string = true;
+                string_is_key = true;
+            } else {
+                fail("Expected object key", c);
+            }
+            break;
+        case State::COLON:
+            if (c == ':') {
+                state = State::VALUE;
+            } else {
+                fail("Expected ':'", c);
+            }
+            break;
+        case State::COMMA_OR_END:
+            if (c == ',') {
+                state = stack.back() == '{' ? State::KEY : State::VALUE;
+            } else if (c == '}' || c == ']') {
+                close(c);
+            } else {
+                fail("Expected ',' or closing bracket", c);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void JsonStreamParser::open(char bracket) {
+    if (stack.size() >= static_cast<size_t>(kMaxDepth)) {
+        fail("JSON nested too deeply", bracket);
+        return;
+    }
+    stack.push_back(bracket);
+    if (bracket == '{') {
+        handler.startObject();
+        state = State::FIRST_KEY;
+    } else {
+        handler.startArray();
+        state = State::FIRST_VALUE;
+    }
+}
+
+void JsonStreamParser::close(char bracket) {
+    if ((bracket == '}') != (stack.back() == '{')) {
+        fail("Mismatched closing bracket", bracket);
+        return;
+    }
+    stack.pop_back();
+    if (bracket == '}') {
+        handler.endObject();
+    } else {
+        handler.endArray();
+    }
+    afterValue();
+}
+
+void JsonStreamParser::afterValue() {
+    state = stack.empty() ? State::DONE : State::COMMA_OR_END;
+}
+
+bool JsonStreamParser::endScalar() {
+    std::string text = std::move(scalar);
+    scalar.clear();
+    
+    if (text == "true" || text == "false") {
+        handler.boolean(text == "true");
+    } else if (text == "null") {
+        handler.null();
+    } else {
+        // JSON number: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+        size_t pos = text[0] == '-' ? 1 : 0;
+        auto digits = [&]() {
+            size_t start = pos;
+            while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+                pos++;
+            }
+            return pos - start;
+        };
+        size_t integer_start = pos;
+        bool valid = digits() > 0 && (text[integer_start] != '0' || pos == integer_start + 1);
+        if (valid && pos < text.size() && text[pos] == '.') {
+            pos++;
+            valid = digits() > 0;
+        }
+        if (valid && pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+            pos++;
+            if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+                pos++;
+            }
+            valid = digits() > 0;
+        }
+        if (!valid || pos != text.size()) {
+            state = State::FAILED;
+            error_message = "Malformed literal '" + text + "' at offset " + std::to_string(offset - 1 - text.size());
+            return false;
+        }
+        handler.number(text);
+    }
+    
+    afterValue();
+    return true;
+}
+
+void JsonStreamParser::stringChar(char c) {
+    if (unicode_digits >= 0) {
+        int digit = (c >= '0' && c <= '9') ? c - '0' :
+                    (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                    (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            fail("Invalid unicode escape", c);
+            return;
+        }
+        unicode = (unicode << 4) | static_cast<unsigned>(digit);
+        if (++unicode_digits == 4) {
+            unicode_digits = -1;
+            unicodeEscape(unicode);
+        }
+        return;
+    }
+    
+    if (escaped) {
+        escaped = false;
+        if (c == 'u') {
+            unicode = 0;
+            unicode_digits = 0;
+            return;
+        }
+        flushSurrogate();
+        switch (c) {
+            case '"': buffer += '"'; break;
+            case '\\': buffer += '\\'; break;
+            case '/': buffer += '/'; break;
+            case 'b': buffer += '\b'; break;
+            case 'f': buffer += '\f'; break;
+            case 'n': buffer += '\n'; break;
+            case 'r': buffer += '\r'; break;
+            case 't': buffer += '\t'; break;
+            default:
+                fail("Invalid escape", c);
+        }
+        return;
+    }
+    
+    if (c == '\\') {
+        escaped = true;
+        return;
+    }
+    
+    flushSurrogate();
+    if (c == '"') {
+        in_string = false;
+        if (string_is_key) {
+            handler.key(std::move(buffer));
+            state = State::COLON;
+        } else {
+            handler.string(std::move(buffer));
+            afterValue();
+        }
+        buffer.clear();
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+        fail("Control character in string", c);
+    } else {
+        buffer += c;
+    }
+}
+
+void JsonStreamParser::unicodeEscape(unsigned code) {
+    if (high_surrogate != 0 && code >= 0xDC00 && code <= 0xDFFF) {
+        appendUtf8(buffer, 0x10000 + ((high_surrogate - 0xD800) << 10) + (code - 0xDC00));
+        high_surrogate = 0;
+        return;
+    }
+    flushSurrogate();
+    if (code >= 0xD800 && code <= 0xDBFF) {
+        high_surrogate = code; // Completed by a following low surrogate escape
+    } else {
+        appendUtf8(buffer, code);
+    }
+}
+
+void JsonStreamParser::flushSurrogate() {
+    if (high_surrogate != 0) {
+        appendUtf8(buffer, 0xFFFD); // Unpaired surrogate
+        high_surrogate = 0;
+    }
+}
+
+void JsonStreamParser::fail(const std::string& message, char c) {
+    state = State::FAILED;
+    error_message = message + " '" + std::string(1, c) + "' at offset " + std::to_string(offset - 1);
+}
+
+std::string jsonEscape(const std::string& value) {
+    std::string out = "\"";
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    out += buffer;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    return out + "\"";
+}
@@ -0,0 +1,98 @@
+#ifndef JSON_UTIL_H
+#define JSON_UTIL_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+/**
+ * Minimal JSON document model for the command line tools and trace export
+ */
+struct JsonValue {
+    enum class Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+    
+    Type type = Type::NUL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> items;                            // ARRAY
+    std::vector<std::pair<std::string, JsonValue>> members;  // OBJECT, in document order
+    
+    const JsonValue* get(const std::string& key) const; // nullptr when absent or not an object
+    std::string dump() const;
+    
+    static JsonValue parse(const std::string& text); // Throws std::runtime_error on malformed input
+};
+
+/**
+ * Receives the events of a JsonStreamParser
+ */
+class JsonHandler {
+public:
+    virtual ~JsonHandler() = default;
+    virtual void startObject() = 0;
+    virtual void endObject() = 0;
+    virtual void startArray() = 0;
+    virtual void endArray() = 0;
+    virtual void key(std::string&& name) = 0;
+    virtual void string(std::string&& value) = 0;
+    virtual void number(const std::string& text) = 0; // As written, validated against the JSON grammar
+    virtual void boolean(bool value) = 0;
+    virtual void null() = 0;
+    virtual void reset() = 0; // Forget every event so far: they belonged to a false start
+};
+
+/**
+ * Incremental JSON parser for text that arrives in pieces, e.g. generated tokens
+ *
+ * Anything before the first '{' or '[' is skipped, and parsing stops at the byte
+ * that closes that top-level object or array, so the caller can stop feeding
+ * as soon as done() turns true. A bracket that turns out not to open valid JSON
+ * (prose like "see [the] output") is abandoned: the handler is reset and
+ * scanning resumes after it, with error() describing the rejected candidate.
+ */
+class JsonStreamParser {
+public:
+    explicit JsonStreamParser(JsonHandler& handler);
+    
+    size_t feed(const char* data, size_t size); // Bytes consumed; fewer than size once done
+    size_t feed(const std::string& text) { return feed(text.data(), text.size()); }
+    
+    bool done() const { return state == State::DONE; }
+    bool started() const { return state != State::BEFORE; }
+    const std::string& error() const { return error_message; } // Why the last candidate was rejected
+
+private:
+    enum class State { BEFORE, VALUE, FIRST_VALUE, KEY, FIRST_KEY, COLON, COMMA_OR_END, DONE, FAILED };
+    
+    JsonHandler& handler;
+    State state = State::BEFORE;
+    std::vector<char> stack;    // Open brackets
+    std::string scalar;         // Literal or number being read
+    std::string buffer;         // String being read
+    bool in_string = false;
+    bool string_is_key = false;
+    bool escaped = false;
+    int unicode_digits = -1;    // Hex digits read of a \u escape, -1 = not in one
+    unsigned unicode = 0;
+    unsigned high_surrogate = 0;
+    size_t offset = 0;
+    std::string candidate;      // Text since the opening bracket, rescanned if it fails
+    size_t candidate_offset = 0;
+    std::string error_message;
+    
+    void step(char c);
+    void restart();
+    void open(char bracket);
+    void close(char bracket);
+    void afterValue();
+    bool endScalar();
+    void stringChar(char c);
+    void unicodeEscape(unsigned code);
+    void flushSurrogate();
+    void fail(const std::string& message, char c);
+};
+
+std::string jsonEscape(const std::string& value); // Quoted JSON string literal
+
+#endif
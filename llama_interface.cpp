@@ -1,4 +1,7 @@
 #include "llama_interface.h"
+#include "model_cache.h"
+#include "context_pool.h"
+#include "trace.h"
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -9,44 +12,291 @@
 #include <sstream>
 #include <fstream>
 #include <chrono>
+#include <cmath>
+#include <mutex>
+#include <map>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 // Use ollama's enhanced llama.cpp headers
 #include "llama.h"
+#include "ggml-cpu.h"
 #include "common.h"
 
 /**
  * Wrapper structs to hide llama.cpp implementation details from the header
  * This provides a clean interface while using ollama's enhanced llama.cpp
  */
+struct LlamaAdapter {
+    llama_adapter_lora* adapter = nullptr; // Owned by the llama_model, freed with it
+    std::string path;
+    float scale = 1.0f;
+};
+
 struct LlamaModel {
     llama_model* model = nullptr;
+    std::map<std::string, LlamaAdapter> adapters; // By name
+    std::mutex adapters_mutex;
     ~LlamaModel() {
         if (model) {
+            ContextPool::releaseModel(this); // Pooled contexts must not outlive their model
             llama_model_free(model);
         }
     }
 };
 
+/**
+ * ggml threadpool shared by every context created with the same size and affinity
+ * A threadpool can only run one graph at a time, so computes are serialized on compute_mutex
+ */
+struct SharedThreadPool {
+    ggml_threadpool* pool = nullptr;
+    std::mutex compute_mutex;
+    ~SharedThreadPool() {
+        if (pool) {
+            ggml_threadpool_free(pool);
+        }
+    }
+};
+
 struct LlamaContext {
     llama_context* ctx = nullptr;
+    std::shared_ptr<SharedThreadPool> threadpool; // Used for both prefill and decode
+    std::string pool_key;     // Context parameters it was created with, empty = not poolable
+    uint64_t generations = 0; // Across every instance that checked it out
+    std::vector<llama_token> kv_tokens;   // Held by sequence 0 of the KV cache, in position order
+    std::string chat_prompt;              // Last prompt rendered by chat()
+    std::vector<llama_token> chat_tokens; // Its tokenization
+    std::string kv_scope;                 // Cache scope of whoever filled the KV cells above
     ~LlamaContext() {
         if (ctx) {
-            llama_free(ctx);
+            llama_free(ctx); // Detaches from the threadpool before it is released
         }
     }
 };
 
+struct LlamaSampler {
+    llama_sampler* chain = nullptr;
+    bool greedy = false; // Pure argmax: sampled straight from the logits without the chain
+    ~LlamaSampler() {
+        if (chain) {
+            llama_sampler_free(chain);
+        }
+    }
+};
+
+namespace {
+    const int kMaxSequences = 16; // Parallel KV sequences per context (score, n-completions)
+    
+    /**
+     * RAII wrapper for batches built with llama_batch_init
+     */
+    struct LlamaBatch {
+        llama_batch batch;
+        LlamaBatch(int n_tokens, int n_seq_max) : batch(llama_batch_init(n_tokens, 0, n_seq_max)) {}
+        ~LlamaBatch() { llama_batch_free(batch); }
+        
+        void clear() { batch.n_tokens = 0; }
+        
+        void add(llama_token token, llama_pos pos, llama_seq_id seq, bool logits) {
+            int i = batch.n_tokens++;
+            batch.token[i] = token;
+            batch.pos[i] = pos;
+            batch.n_seq_id[i] = 1;
+            batch.seq_id[i][0] = seq;
+            batch.logits[i] = logits;
+        }
+    };
+    
+    float logSumExp(const float* logits, int n_vocab) {
+        float max_logit = *std::max_element(logits, logits + n_vocab);
+        double sum = 0.0;
+        for (int i = 0; i < n_vocab; i++) {
+            sum += std::exp(logits[i] - max_logit);
+        }
+        return max_logit + static_cast<float>(std::log(sum));
+    }
+    
+    /**
+     * Indices of the k largest logits, highest first
+     */
+    std::vector<llama_token> topTokens(const float* logits, int n_vocab, int k) {
+        std::vector<llama_token> top;
+        top.reserve(k + 1);
+        auto lower = [logits](llama_token a, llama_token b) { return logits[a] > logits[b]; };
+        for (llama_token id = 0; id < n_vocab; id++) {
+            if (static_cast<int>(top.size()) < k || logits[id] > logits[top.front()]) {
+                top.push_back(id);
+                std::push_heap(top.begin(), top.end(), lower);
+                if (static_cast<int>(top.size()) > k) {
+                    std::pop_heap(top.begin(), top.end(), lower);
+                    top.pop_back();
+                }
+            }
+        }
+        std::sort_heap(top.begin(), top.end(), lower);
+        return top;
+    }
+    
+    /**
+     * Prompt lookup: find the most recent earlier occurrence of the trailing n-gram of `history`,
+     * longest n-gram first, and propose up to n_draft tokens that followed it
+     */
+    std::vector<llama_token> lookupDraft(const std::vector<llama_token>& history, int ngram_max, int n_draft) {
+        const int n_history = static_cast<int>(history.size());
+        for (int n = std::min(ngram_max, n_history - 1); n >= 1; n--) {
+            const llama_token* suffix = history.data() + n_history - n;
+            for (int i = n_history - n - 1; i >= 0; i--) {
+                if (std::equal(suffix, suffix + n, history.data() + i)) {
+                    int from = i + n;
+                    int to = std::min(n_history, from + n_draft);
+                    return std::vector<llama_token>(history.begin() + from, history.begin() + to);
+                }
+            }
+        }
+        return {};
+    }
+    
+    int64_t steadyNowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    std::once_flag numa_once;
+    
+    /**
+     * Pins the calling thread to a set of CPUs and puts its previous mask back on restore()
+     * or destruction, so a request or loadAsync thread is not left pinned after a load
+     */
+    class AffinityGuard {
+    public:
+        AffinityGuard() = default;
+        AffinityGuard(const AffinityGuard&) = delete;
+        AffinityGuard& operator=(const AffinityGuard&) = delete;
+        ~AffinityGuard() { restore(); }
+        
+        void pin(const std::vector<int>& cpus) {
+            if (cpus.empty() || pinned || sched_getaffinity(0, sizeof(saved), &saved) != 0) {
+                return;
+            }
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus) {
+                CPU_SET(cpu, &set);
+            }
+            pinned = sched_setaffinity(0, sizeof(set), &set) == 0;
+        }
+        
+        void restore() {
+            if (pinned) {
+                sched_setaffinity(0, sizeof(saved), &saved);
+                pinned = false;
+            }
+        }
+        
+    private:
+        cpu_set_t saved;
+        bool pinned = false;
+    };
+    
+    /**
+     * Initialize ggml's NUMA support; ggml only honours the first call per process
+     * When isolating to an explicit node, the loading thread is moved there through `affinity`
+     * so that ggml treats it as the current node and mmap'd weights are first touched there;
+     * the caller restores the thread's mask once the load is done
+     */
+    void initNuma(const HardwareConfig& config, AffinityGuard& affinity) {
+        if (config.numa == NumaStrategy::DISABLED) {
+            return;
+        }
+        
+        std::call_once(numa_once, [&config, &affinity]() {
+            if (config.numa == NumaStrategy::ISOLATE && config.numa_node >= 0) {
+                affinity.pin(LlamaInterface::getNumaNodeCPUs(config.numa_node));
+            }
+            llama_numa_init(static_cast<ggml_numa_strategy>(config.numa));
+        });
+    }
+    
+    /**
+     * Pool key covering everything a context is created with, so a pooled one behaves
+     * like a fresh one; a parameter set in loadModel() must be added here too
+     */
+    std::string contextKey(const llama_context_params& params, int pool_threads, const std::vector<int>& cpus) {
+        std::string key = "n_ctx=" + std::to_string(params.n_ctx) +
+            "|n_batch=" + std::to_string(params.n_batch) +
+            "|n_ubatch=" + std::to_string(params.n_ubatch) +
+            "|n_seq_max=" + std::to_string(params.n_seq_max) +
+            "|threads=" + std::to_string(params.n_threads) + "/" + std::to_string(params.n_threads_batch) +
+            "|type_kv=" + std::to_string(params.type_k) + "/" + std::to_string(params.type_v) +
+            "|embeddings=" + std::to_string(params.embeddings) +
+            "|pooling=" + std::to_string(params.pooling_type) +
+            "|pool=" + std::to_string(pool_threads) + "@";
+        for (int cpu : cpus) {
+            key += std::to_string(cpu) + ",";
+        }
+        return key;
+    }
+    
+    std::mutex pools_mutex;
+    std::map<std::string, std::weak_ptr<SharedThreadPool>> shared_pools;
+    int thread_pool_size = -1;
+    ThreadPoolPolicy thread_pool_policy = ThreadPoolPolicy::INTERLEAVE;
+    
+    /**
+     * Return the process-wide threadpool for this size and affinity, creating it on first use
+     * With an affinity mask its threads are pinned one-to-one onto `cpus`
+     */
+    std::shared_ptr<SharedThreadPool> acquireThreadPool(int n_threads, const std::vector<int>& cpus) {
+        std::string key = std::to_string(n_threads) + "@";
+        for (int cpu : cpus) {
+            key += std::to_string(cpu) + ",";
+        }
+        
+        std::lock_guard<std::mutex> lock(pools_mutex);
+        auto existing = shared_pools[key].lock();
+        if (existing) {
+            return existing;
+        }
+        
+        ggml_threadpool_params params = ggml_threadpool_params_default(n_threads);
+        if (!cpus.empty()) {
+            for (int cpu : cpus) {
+                if (cpu >= 0 && cpu < GGML_MAX_N_THREADS) {
+                    params.cpumask[cpu] = true;
+                }
+            }
+            params.strict_cpu = true;
+        }
+        
+        auto shared = std::make_shared<SharedThreadPool>();
+        shared->pool = ggml_threadpool_new(&params);
+        if (!shared->pool) {
+            return nullptr;
+        }
+        shared_pools[key] = shared;
+        return shared;
+    }
+}
+
 /**
  * Constructor - Initialize llama backend
  * Uses ollama's enhanced llama.cpp with production patches
  */
 LlamaInterface::LlamaInterface() 
-    : model(std::make_unique<LlamaModel>())
-    , context(std::make_unique<LlamaContext>()) {
+    : model(std::make_shared<LlamaModel>())
+    , context(std::make_shared<LlamaContext>())
+    , sampler(std::make_unique<LlamaSampler>()) {
+    
+    // Until told otherwise, preserved KV is only ever reused by the instance that computed it
+    static std::atomic<uint64_t> next_instance{0};
+    cache_scope = "instance:" + std::to_string(next_instance.fetch_add(1) + 1);
     
     // Initialize ollama's enhanced llama.cpp backend
     llama_backend_init();
-    
+
 }
 
 /**
@@ -54,7 +304,8 @@ LlamaInterface::LlamaInterface()
  * Resources are automatically cleaned up by the wrapper structs
  */
 LlamaInterface::~LlamaInterface() {
-    // Resources are automatically cleaned up by LlamaModel and LlamaContext destructors
+    // The context goes back to the pool; the rest is cleaned up by the wrapper destructors
+    releaseContext();
     llama_backend_free();
 }
 
@@ -67,6 +318,8 @@ bool LlamaInterface::loadModel(const std::string& path) {
 }
 
 bool LlamaInterface::loadModel(const std::string& path, const HardwareConfig& config) {
+    TraceSpan span("LlamaInterface::loadModel");
+    releaseContext(); // Before the model it belongs to can be replaced
     model_path = path;
     hardware_config = config;
     
@@ -84,9 +337,35 @@ bool LlamaInterface::loadModel(const std::string& path, const HardwareConfig& co
         llama_model_params model_params = llama_model_default_params();
         
         // Configure GPU usage based on detected/configured mode
-        HardwareConfig effective_config = (config.gpu_mode == GPUMode::AUTO) ? 
-            detectOptimalConfig() : config;
-            
+        HardwareConfig effective_config = config;
+        if (config.gpu_mode == GPUMode::AUTO) {
+            // Auto-detect the GPU layout but keep explicit CPU placement settings
+            effective_config = detectOptimalConfig();
+            if (config.cpu_threads != -1) {
+                effective_config.cpu_threads = config.cpu_threads;
+            }
+            effective_config.prefill_threads = config.prefill_threads;
+            effective_config.decode_threads = config.decode_threads;
+            effective_config.numa = config.numa;
+            effective_config.numa_node = config.numa_node;
+            effective_config.prefetch_threads = config.prefetch_threads;
+            effective_config.cpu_affinity = config.cpu_affinity;
+            effective_config.use_mmap = config.use_mmap;
+            effective_config.use_mlock = config.use_mlock;
+            effective_config.context_size = config.context_size;
+            effective_config.batch_size = config.batch_size;
+        }
+        
+        // Isolating to an explicit node pins compute threads to that node's CPUs
+        if (effective_config.numa == NumaStrategy::ISOLATE && effective_config.numa_node >= 0 &&
+            effective_config.cpu_affinity.empty()) {
+            effective_config.cpu_affinity = getNumaNodeCPUs(effective_config.numa_node);
+        }
+        
+        // Must precede the load so weights are placed according to the strategy
+        AffinityGuard load_affinity;
+        initNuma(effective_config, load_affinity);
+        
         switch (effective_config.gpu_mode) {
             case GPUMode::CPU_ONLY:
                 model_params.n_gpu_layers = 0;
@@ -111,16 +390,47 @@ bool LlamaInterface::loadModel(const std::string& path, const HardwareConfig& co
         
         hardware_config = effective_config; // Store the effective config
         
-        // Load the model using ollama's enhanced loader
-        model->model = llama_model_load_from_file(path.c_str(), model_params);
-        if (!model->model) {
+        // Load the model using ollama's enhanced loader, reusing a resident copy when cached
+        std::string cache_key = path +
+            "|ngl=" + std::to_string(model_params.n_gpu_layers) +
+            "|gpu=" + std::to_string(model_params.main_gpu) +
+            "|mmap=" + std::to_string(model_params.use_mmap) +
+            "|mlock=" + std::to_string(model_params.use_mlock);
+        
+        // With prefetching, streaming the file counts as the first half of the progress
+        const float load_share = effective_config.prefetch_threads > 0 ? 0.5f : 1.0f;
+        load_progress = 0.0f;
+        model_params.progress_callback = onLoadProgress;
+        model_params.progress_callback_user_data = this;
+        
+        model = ModelCache::acquire(cache_key, path, std::filesystem::file_size(path),
+            [&](size_t& resident_bytes) -> std::shared_ptr<LlamaModel> {
+                if (effective_config.prefetch_threads > 0) {
+                    TraceSpan prefetch_span("prefetch");
+                    prefetchFile(path, effective_config.prefetch_threads, [&](float done) {
+                        load_progress = done * (1.0f - load_share);
+                    });
+                }
+                
+                TraceSpan weights_span("load_weights");
+                auto loaded = std::make_shared<LlamaModel>();
+                loaded->model = llama_model_load_from_file(path.c_str(), model_params);
+                if (!loaded->model) {
+                    return nullptr;
+                }
+                resident_bytes = llama_model_size(loaded->model);
+                return loaded;
+            });
+        load_affinity.restore();
+        if (!model || !model->model) {
             return false;
         }
+        load_progress = 1.0f;
         
         // Set up context parameters optimized for this hardware
         llama_context_params ctx_params = llama_context_default_params();
-        ctx_params.n_ctx = 2048;      // Context window size
-        ctx_params.n_batch = 512;     // Batch size for processing
+        ctx_params.n_ctx = effective_config.context_size;  // Context window size
+        ctx_params.n_batch = effective_config.batch_size;  // Batch size for processing
         
         // Configure threads based on GPU mode and available hardware
         int optimal_threads;
@@ -134,26 +444,172 @@ bool LlamaInterface::loadModel(const std::string& path, const HardwareConfig& co
             }
         }
         
-        ctx_params.n_threads = optimal_threads;
-        ctx_params.n_threads_batch = optimal_threads;
+        // Never run more threads than there are CPUs to pin them to
+        if (!effective_config.cpu_affinity.empty()) {
+            optimal_threads = std::min(optimal_threads, static_cast<int>(effective_config.cpu_affinity.size()));
+        } else if (effective_config.numa == NumaStrategy::ISOLATE) {
+            int node_cpus = static_cast<int>(getNumaNodeCPUs(std::max(0, effective_config.numa_node)).size());
+            if (node_cpus > 0) {
+                optimal_threads = std::min(optimal_threads, node_cpus);
+            }
+        }
+        
+        // Decode is memory-bandwidth bound and prefill compute bound, so they can be sized apart
+        int decode_threads = effective_config.decode_threads > 0 ? effective_config.decode_threads : optimal_threads;
+        int prefill_threads = effective_config.prefill_threads > 0 ? effective_config.prefill_threads : optimal_threads;
+        
+        ctx_params.n_threads = decode_threads;
+        ctx_params.n_threads_batch = prefill_threads;
+        ctx_params.n_seq_max = kMaxSequences;
         ctx_params.type_k = GGML_TYPE_F16; // Use F16 for KV cache to save memory
         ctx_params.type_v = GGML_TYPE_F16;
+        ctx_params.abort_callback = onAbort;
+        ctx_params.abort_callback_data = this;
+        
+        // Attach the process-wide threadpool so instances don't each spawn a full set of threads;
+        // contexts asking for fewer threads than the pool holds use a subset of it
+        int pool_threads = getThreadPoolSize();
+        if (pool_threads == -1) {
+            pool_threads = effective_config.cpu_affinity.empty() ? getOptimalCPUThreads() :
+                static_cast<int>(effective_config.cpu_affinity.size());
+        } else if (pool_threads == 0 && !effective_config.cpu_affinity.empty()) {
+            pool_threads = std::max(decode_threads, prefill_threads); // Pinning still needs a pool
+        }
+        
+        std::string context_key = contextKey(ctx_params, pool_threads, effective_config.cpu_affinity);
+        
+        context = ContextPool::checkout(context_key, model.get());
+        if (context) {
+            // The abort callback still points at the instance that returned the context
+            llama_set_abort_callback(context->ctx, onAbort, this);
+            hardware_config = effective_config;
+            return true;
+        }
         
         // Create context with ollama's enhanced context management
+        TraceSpan context_span("create_context");
+        context = std::make_shared<LlamaContext>();
         context->ctx = llama_init_from_model(model->model, ctx_params);
         if (!context->ctx) {
             return false;
         }
         
+        if (pool_threads > 0) {
+            context->threadpool = acquireThreadPool(pool_threads, effective_config.cpu_affinity);
+            if (context->threadpool) {
+                llama_attach_threadpool(context->ctx, context->threadpool->pool, context->threadpool->pool);
+            }
+        }
+        context->pool_key = context_key;
         
+        hardware_config = effective_config;
         return true;
-        
+    
+    } catch (const ModelCacheError&) {
+        throw; // Budget violations are reported to the caller verbatim
     } catch (const std::exception& e) {
         return false;
     }
 }
 
-std::string LlamaInterface::generate(const std::string& prompt, int max_tokens) {
+/**
+ * Hand the context back to the pool, reset for its next user
+ */
+void LlamaInterface::releaseContext() {
+    if (!context || !context->ctx || context->pool_key.empty() || !model || !model->model) {
+        context.reset();
+        return;
+    }
+    
+    // Adapters are per request; the KV cache (and the conversation it holds) only survives
+    // under the preserve policy, and only if it was computed without an adapter
+    if (ContextPool::getConfig().reset == ContextPool::ResetPolicy::CLEAR || !active_adapter.empty()) {
+        llama_kv_self_clear(context->ctx);
+        context->kv_tokens.clear();
+        context->chat_prompt.clear();
+        context->chat_tokens.clear();
+    }
+    llama_clear_adapter_lora(context->ctx);
+    active_adapter.clear();
+    llama_set_abort_callback(context->ctx, nullptr, nullptr);
+    
+    std::string key = context->pool_key;
+    uint64_t generations = context->generations;
+    ContextPool::checkin(key, model.get(), std::move(context), generations);
+    context.reset();
+}
+
+float LlamaInterface::getLoadProgress() const {
+    return load_progress;
+}
+
+void LlamaInterface::cancelLoad() {
+    load_cancelled = true;
+}
+
+/**
+ * llama.cpp load progress callback; returning false aborts the load
+ */
+bool LlamaInterface::onLoadProgress(float progress, void* user_data) {
+    auto* self = static_cast<LlamaInterface*>(user_data);
+    float prefetched = self->hardware_config.prefetch_threads > 0 ? 0.5f : 0.0f;
+    self->load_progress = prefetched + progress * (1.0f - prefetched);
+    return !self->load_cancelled;
+}
+
+/**
+ * Stream a model file into the page cache with several threads in parallel
+ * Cold mmap loads otherwise fault the weights in one page at a time; after this
+ * the loader's first touches hit the page cache instead of the disk
+ */
+void LlamaInterface::prefetchFile(const std::string& path, int n_threads,
+                                  const std::function<void(float)>& progress) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return;
+    }
+    
+    const off_t file_size = st.st_size;
+    const off_t chunk_size = 64 << 20;
+    const size_t n_chunks = static_cast<size_t>((file_size + chunk_size - 1) / chunk_size);
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<size_t> chunks_done{0};
+    
+    auto stream = [&](bool report) {
+        for (size_t chunk = next_chunk++; chunk < n_chunks; chunk = next_chunk++) {
+            off_t offset = static_cast<off_t>(chunk) * chunk_size;
+            size_t length = static_cast<size_t>(std::min(chunk_size, file_size - offset));
+            // readahead() populates the page cache synchronously; fall back to an async hint
+            if (readahead(fd, offset, length) != 0) {
+                posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+            }
+            chunks_done++;
+            if (report && progress) {
+                progress(static_cast<float>(chunks_done) / n_chunks);
+            }
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    for (int i = 1; i < n_threads; i++) {
+        workers.emplace_back(stream, false);
+    }
+    stream(true); // The calling thread streams too and reports progress
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    
+    close(fd);
+}
+
+std::string LlamaInterface::generate(const std::string& prompt, int max_tokens,
+                                     const std::function<bool(const std::string&)>& on_piece) {
     if (!model || !model->model || !context || !context->ctx) {
         throw std::runtime_error("Model not properly initialized");
     }
@@ -166,148 +622,1383 @@ std::string LlamaInterface::generate(const std::string& prompt, int max_tokens)
         throw std::runtime_error("max_tokens must be between 1 and 4096");
     }
     
+    TraceSpan span("LlamaInterface::generate");
+    
     // Tokenize the prompt
-    const auto vocab = llama_model_get_vocab(model->model);
     std::vector<llama_token> tokens;
-    tokens.resize(prompt.length() + 1);
-    int n_tokens = llama_tokenize(vocab, prompt.c_str(), prompt.length(), 
-                                  tokens.data(), tokens.size(), true, true);
-    if (n_tokens < 0) {
-        throw std::runtime_error("Failed to tokenize prompt");
+    {
+        TraceSpan tokenize_span("tokenize");
+        tokens = tokenize(prompt, true);
+        tokenize_span.arg("tokens", static_cast<int64_t>(tokens.size()));
     }
-    tokens.resize(n_tokens);
     
-    // Clear the KV cache
-    llama_kv_self_clear(context->ctx);
+    return generateTokens(std::move(tokens), max_tokens, on_piece);
+}
+
+/**
+ * Reply to a conversation, rendered with the model's chat template
+ * The rendered prompt and its tokens are kept with the context: when the next call's prompt
+ * extends it (the same history plus new turns), only the appended text is tokenized, and
+ * generateTokens() reuses the KV cells of the shared prefix
+ */
+std::string LlamaInterface::chat(const std::vector<ChatMessage>& messages, int max_tokens,
+                                 const std::function<bool(const std::string&)>& on_piece) {
+    if (!model || !model->model || !context || !context->ctx) {
+        throw std::runtime_error("Model not properly initialized");
+    }
     
-    // Process the prompt tokens
-    if (llama_decode(context->ctx, llama_batch_get_one(tokens.data(), tokens.size()))) {
-        throw std::runtime_error("Failed to decode prompt");
+    if (messages.empty()) {
+        throw std::runtime_error("At least one message is required");
     }
     
-    // Generate response with safer sampling parameters
-    std::string response;
-    llama_sampler* sampler = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    if (max_tokens <= 0 || max_tokens > 4096) {
+        throw std::runtime_error("max_tokens must be between 1 and 4096");
+    }
     
-    // Use more conservative sampling to avoid assertion errors
-    llama_sampler_chain_add(sampler, llama_sampler_init_temp(std::max(0.1f, temperature)));
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_k(std::max(1, std::min(top_k, 50))));
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_p(std::max(0.1f, std::min(top_p, 0.95f)), 1));
+    TraceSpan span("LlamaInterface::chat");
+    span.arg("messages", static_cast<int64_t>(messages.size()));
     
-    for (int i = 0; i < max_tokens; i++) {
-        llama_token new_token = llama_sampler_sample(sampler, context->ctx, -1);
-        
-        // Check for end of sequence
-        if (llama_vocab_is_eog(vocab, new_token)) {
-            break;
-        }
-        
-        // Convert token to text
-        char token_str[256];
-        int token_len = llama_token_to_piece(vocab, new_token, token_str, sizeof(token_str), 0, true);
-        if (token_len > 0) {
-            response.append(token_str, token_len);
+    enterCacheScope();
+    std::string prompt = applyChatTemplate(messages, true);
+    
+    std::vector<llama_token> tokens;
+    {
+        TraceSpan tokenize_span("tokenize");
+        const std::string& cached = context->chat_prompt;
+        if (!cached.empty() && prompt.size() > cached.size() && prompt.compare(0, cached.size(), cached) == 0) {
+            tokens = tokenizeAppended(prompt);
+            tokenize_span.arg("cached", static_cast<int64_t>(tokens.empty() ? 0 : context->chat_tokens.size()));
         }
-        
-        // Process the new token
-        if (llama_decode(context->ctx, llama_batch_get_one(&new_token, 1))) {
-            break;
+        if (tokens.empty()) {
+            tokens = tokenize(prompt, true);
         }
+        tokenize_span.arg("tokens", static_cast<int64_t>(tokens.size()));
     }
+    context->chat_prompt = prompt;
+    context->chat_tokens = tokens;
     
-    llama_sampler_free(sampler);
-    return response;
-}
-
-void LlamaInterface::setTemperature(float temperature) {
-    this->temperature = temperature;
-}
-
-void LlamaInterface::setTopP(float top_p) {
-    this->top_p = top_p;
-}
-
-void LlamaInterface::setTopK(int top_k) {
-    this->top_k = top_k;
+    return generateTokens(std::move(tokens), max_tokens, on_piece);
 }
 
-void LlamaInterface::clearCache() {
-    if (context && context->ctx) {
-        llama_kv_self_clear(context->ctx);
+/**
+ * Tokenize `prompt`, which extends the cached chat prompt, reusing the cached tokens
+ * Text is never merged across a special token, and the text after one is tokenized the
+ * same wherever it starts (SPM's space prefix included), so everything from the cached
+ * prompt's last special token on is tokenized alone and appended to the tokens before it.
+ * Returns an empty vector when the cached tokens cannot be reused that way.
+ */
+std::vector<llama_token> LlamaInterface::tokenizeAppended(const std::string& prompt) {
+    const auto vocab = llama_model_get_vocab(model->model);
+    const std::vector<llama_token>& cached_tokens = context->chat_tokens;
+    const std::string& cached = context->chat_prompt;
+    
+    size_t k = cached_tokens.size();
+    while (k > 0 && !(llama_vocab_get_attr(vocab, cached_tokens[k - 1]) &
+                      (LLAMA_TOKEN_ATTR_CONTROL | LLAMA_TOKEN_ATTR_USER_DEFINED))) {
+        k--;
     }
+    if (k == 0) {
+        return {};
+    }
+    
+    // No special text follows the last special token, so its last occurrence is that token
+    size_t at = cached.rfind(tokenToPiece(cached_tokens[k - 1]));
+    if (at == std::string::npos) {
+        return {}; // Added by the tokenizer (BOS) rather than written by the template
+    }
+    
+    // The tail must start with that same special token for the two halves to line up
+    std::vector<llama_token> tail = tokenize(prompt.substr(at), false);
+    if (tail.empty() || tail.front() != cached_tokens[k - 1]) {
+        return {};
+    }
+    
+    std::vector<llama_token> tokens(cached_tokens.begin(), cached_tokens.begin() + (k - 1));
+    tokens.insert(tokens.end(), tail.begin(), tail.end());
+    return tokens;
 }
 
-void LlamaInterface::setHardwareConfig(const HardwareConfig& config) {
-    hardware_config = config;
-}
-
-HardwareConfig LlamaInterface::getHardwareConfig() const {
-    return hardware_config;
+/**
+ * Render messages with the chat template embedded in the model's GGUF metadata
+ */
+std::string LlamaInterface::applyChatTemplate(const std::vector<ChatMessage>& messages, bool add_assistant) {
+    const char* tmpl = llama_model_chat_template(model->model, nullptr);
+    if (!tmpl) {
+        throw std::runtime_error("Model has no chat template");
+    }
+    
+    std::vector<llama_chat_message> chat;
+    size_t length = 0;
+    for (const auto& message : messages) {
+        chat.push_back({message.role.c_str(), message.content.c_str()});
+        length += message.role.size() + message.content.size();
+    }
+    
+    // The rendered size is returned when the buffer is too small
+    std::vector<char> buffer(length * 2 + 256);
+    int32_t n = llama_chat_apply_template(tmpl, chat.data(), chat.size(), add_assistant,
+                                          buffer.data(), static_cast<int32_t>(buffer.size()));
+    if (n > static_cast<int32_t>(buffer.size())) {
+        buffer.resize(n);
+        n = llama_chat_apply_template(tmpl, chat.data(), chat.size(), add_assistant,
+                                      buffer.data(), static_cast<int32_t>(buffer.size()));
+    }
+    if (n < 0) {
+        throw std::runtime_error("Unsupported chat template");
+    }
+    return std::string(buffer.data(), n);
 }
 
-int LlamaInterface::detectGPUCount() {
-    // Try to get GPU count from nvidia-smi
-    FILE* pipe = popen("nvidia-smi --query-gpu=count --format=csv,noheader,nounits 2>/dev/null | wc -l", "r");
-    if (pipe) {
-        char buffer[32];
-        if (fgets(buffer, sizeof(buffer), pipe)) {
-            int count = std::atoi(buffer);
-            pclose(pipe);
-            return count;
+/**
+ * Generate from an already tokenized prompt
+ */
+std::string LlamaInterface::generateTokens(std::vector<llama_token> tokens, int max_tokens,
+                                           const std::function<bool(const std::string&)>& on_piece) {
+    const auto vocab = llama_model_get_vocab(model->model);
+    int n_tokens = static_cast<int>(tokens.size());
+    if (n_tokens == 0) {
+        throw std::runtime_error("Prompt is empty after tokenization");
+    }
+    
+    const int n_ctx = static_cast<int>(llama_n_ctx(context->ctx));
+    
+    // A leading BOS is always pinned: models degrade badly once it is shifted out
+    const bool has_bos = tokens[0] == llama_vocab_bos(vocab);
+    const int n_keep = std::min(std::max(keep_tokens, has_bos ? 1 : 0), n_tokens);
+    
+    last_info = GenerationInfo();
+    last_info.prompt_tokens = n_tokens;
+    
+    // A prompt that cannot fit is cut in the middle: the pinned head is kept, along with
+    // as much of the most recent tail as leaves room to generate
+    if (n_tokens >= n_ctx) {
+        if (!context_shift) {
+            throw std::runtime_error("Prompt is " + std::to_string(n_tokens) + " tokens but the context window is " +
+                                     std::to_string(n_ctx) + "; enable context shifting or shorten the prompt");
         }
-        pclose(pipe);
+        int n_room = std::min(max_tokens, n_ctx / 2);
+        int n_tail = n_ctx - n_room - n_keep;
+        last_info.prompt_tokens_truncated = n_tokens - n_keep - n_tail;
+        tokens.erase(tokens.begin() + n_keep, tokens.end() - n_tail);
+        n_tokens = static_cast<int>(tokens.size());
     }
     
-    // Fallback: try to detect via /proc
-    std::ifstream nvidia_smi("/proc/driver/nvidia/gpus");
-    if (!nvidia_smi.is_open()) {
-        return 0; // No NVIDIA driver or GPUs
+    auto pool_lock = lockThreadPool();
+    
+    auto start_time = std::chrono::steady_clock::now();
+    
+    enterCacheScope();
+    
+    // Every N-th generation on this context starts from an empty cache
+    if (auto_clear_cache > 0 && context->generations > 0 && context->generations % auto_clear_cache == 0) {
+        clearCache();
     }
     
-    int gpu_count = 0;
-    std::string line;
-    while (std::getline(nvidia_smi, line)) {
-        if (line.find("GPU-") != std::string::npos) {
-            gpu_count++;
-        }
+    // Keep the KV cells of the longest prefix shared with what the cache holds (earlier turns
+    // of a conversation, a common system prompt) and prefill only the rest; the last prompt
+    // token is always decoded again for its logits
+    size_t n_reuse = 0;
+    while (n_reuse < context->kv_tokens.size() && n_reuse + 1 < tokens.size() &&
+           context->kv_tokens[n_reuse] == tokens[n_reuse]) {
+        n_reuse++;
+    }
+    // Recurrent and hybrid caches cannot drop a partial range; start from scratch there
+    if (n_reuse > 0 && !llama_kv_self_seq_rm(context->ctx, 0, static_cast<llama_pos>(n_reuse), -1)) {
+        n_reuse = 0;
+    }
+    if (n_reuse == 0) {
+        llama_kv_self_clear(context->ctx);
     }
+    context->kv_tokens.clear(); // Unknown until the prefill completes
+    context->generations++;
+    last_info.prompt_tokens_cached = static_cast<int>(n_reuse);
     
-    return gpu_count;
-}
-
-std::vector<std::string> LlamaInterface::getGPUInfo() {
-    std::vector<std::string> gpu_info;
+    std::string interrupted = prefill(tokens, n_reuse);
+    if (!interrupted.empty()) {
+        last_info.stop_reason = interrupted;
+        last_info.prompt_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start_time).count();
+        return "";
+    }
+    context->kv_tokens = tokens;
+    int n_past = n_tokens;
     
-    // Try to get GPU info from nvidia-ml-py or nvidia-smi
-    FILE* pipe = popen("nvidia-smi --query-gpu=name,memory.total --format=csv,noheader,nounits 2>/dev/null", "r");
-    if (pipe) {
-        char buffer[256];
-        while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-            std::string line(buffer);
-            if (!line.empty() && line.back() == '\n') {
-                line.pop_back();
-            }
-            if (!line.empty()) {
-                gpu_info.push_back(line);
-            }
-        }
-        pclose(pipe);
+    auto prompt_done_time = std::chrono::steady_clock::now();
+    
+    // Sampling chain is cached across calls; reset clears penalty history and reseeds
+    if (sampler_dirty) {
+        rebuildSampler();
+    }
+    if (sampler->chain) {
+        llama_sampler_reset(sampler->chain);
     }
     
-    return gpu_info;
-}
-
-int LlamaInterface::getOptimalCPUThreads() {
-    int total_cores = std::thread::hardware_concurrency();
+    std::string response;
+    last_info.stop_reason = "max_tokens";
     
-    // For dual Xeon setup, we want to use most cores but leave some for system
-    if (total_cores >= 16) {
-        return total_cores - 2; // Leave 2 cores for system
-    } else if (total_cores >= 8) {
-        return total_cores - 1; // Leave 1 core for system
-    } else {
-        return std::max(1, total_cores / 2);
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    
+    // Prompt lookup decoding: every token so far is kept so the latest n-gram can be looked up,
+    // and the tokens that followed its previous occurrence are decoded as a draft
+    std::vector<llama_token> history;
+    if (lookup_draft > 0) {
+        history.reserve(tokens.size() + max_tokens);
+        history.assign(tokens.begin(), tokens.end());
     }
+    std::vector<llama_token> draft; // Decoded after the last sampled token, not yet verified
+    LlamaBatch draft_batch(lookup_draft + 1, 1);
+    
+    // After a context shift only the pinned head of the cache matches a fresh prefill
+    bool kv_tracked = true;
+    
+    while (last_info.generated_tokens < max_tokens) {
+        std::string interrupted = interruptReason();
+        if (!interrupted.empty()) {
+            last_info.stop_reason = interrupted;
+            break;
+        }
+        
+        // Sample at each row of the last decode; a drafted token is accepted when the sample
+        // equals it, so the output is exactly what one-token-at-a-time decoding would give.
+        // The first disagreement (or the row after the last draft) is the next token.
+        llama_token new_token = 0;
+        size_t n_accepted = 0;
+        bool stopped = false;
+        for (size_t j = 0; ; j++) {
+            int32_t idx = draft.empty() ? -1 : static_cast<int32_t>(j);
+            {
+                TraceSpan sample_span("sample");
+                new_token = sampleToken(idx);
+            }
+            
+            // Logprobs come from the model's raw distribution, before sampler transforms
+            if (top_logprobs > 0) {
+                const float* logits = llama_get_logits_ith(context->ctx, idx);
+                float lse = logSumExp(logits, n_vocab);
+                TokenLogprob entry;
+                entry.token = tokenToPiece(new_token);
+                entry.logprob = logits[new_token] - lse;
+                for (llama_token id : topTokens(logits, n_vocab, top_logprobs)) {
+                    entry.top.emplace_back(tokenToPiece(id), logits[id] - lse);
+                }
+                last_info.logprobs.push_back(std::move(entry));
+            }
+            
+            // Check for end of sequence
+            if (llama_vocab_is_eog(vocab, new_token)) {
+                last_info.stop_reason = "eos";
+                stopped = true;
+                break;
+            }
+            
+            // Convert token to text
+            std::string piece;
+            {
+                TraceSpan detokenize_span("detokenize");
+                piece = tokenToPiece(new_token);
+            }
+            response += piece;
+            last_info.generated_tokens++;
+            
+            if (on_piece && !on_piece(piece)) {
+                last_info.stop_reason = "complete";
+                stopped = true;
+                break;
+            }
+            
+            if (j < draft.size() && new_token == draft[j] && last_info.generated_tokens < max_tokens) {
+                history.push_back(new_token); // Already in the KV cache
+                n_accepted++;
+                continue;
+            }
+            break;
+        }
+        
+        // Rejected drafts are dropped from the cache
+        if (!draft.empty()) {
+            last_info.draft_accepted += static_cast<int>(n_accepted);
+            n_past -= static_cast<int>(draft.size() - n_accepted);
+            llama_kv_self_seq_rm(context->ctx, 0, n_past, -1);
+            if (kv_tracked) {
+                context->kv_tokens.resize(n_past);
+            }
+        }
+        
+        if (stopped || last_info.generated_tokens >= max_tokens) {
+            break;
+        }
+        
+        // Out of room: drop the oldest half of the unpinned tokens and slide the rest down,
+        // so generation continues without re-processing the window
+        if (n_past + 1 > n_ctx) {
+            if (!context_shift || !llama_kv_self_can_shift(context->ctx)) {
+                last_info.stop_reason = "context_full";
+                break;
+            }
+            int n_discard = (n_past - n_keep) / 2;
+            llama_kv_self_seq_rm(context->ctx, 0, n_keep, n_keep + n_discard);
+            llama_kv_self_seq_add(context->ctx, 0, n_keep + n_discard, n_past, -n_discard);
+            // The shifted cells were computed attending to the discarded ones, so a later
+            // prompt may only reuse the pinned head
+            context->kv_tokens.resize(n_keep);
+            kv_tracked = false;
+            n_past -= n_discard;
+            last_info.context_shifts++;
+        }
+        
+        draft.clear();
+        if (lookup_draft > 0) {
+            history.push_back(new_token);
+            int n_room = std::min({lookup_draft, n_ctx - n_past - 1, max_tokens - last_info.generated_tokens - 1});
+            if (n_room > 0) {
+                draft = lookupDraft(history, lookup_ngram, n_room);
+            }
+        }
+        
+        // Process the new token, followed by the draft in the same batch
+        TraceSpan decode_span("decode");
+        int status;
+        if (draft.empty()) {
+            status = decodeBatch(llama_batch_get_one(&new_token, 1));
+        } else {
+            draft_batch.clear();
+            draft_batch.add(new_token, n_past, 0, true);
+            for (size_t i = 0; i < draft.size(); i++) {
+                draft_batch.add(draft[i], n_past + 1 + static_cast<int>(i), 0, true);
+            }
+            decode_span.arg("draft", static_cast<int64_t>(draft.size()));
+            last_info.draft_tokens += static_cast<int>(draft.size());
+            status = decodeBatch(draft_batch.batch);
+        }
+        if (status) {
+            std::string interrupted = interruptReason();
+            last_info.stop_reason = interrupted.empty() ? "decode_error" : interrupted;
+            context->kv_tokens.clear();
+            break;
+        }
+        n_past += 1 + static_cast<int>(draft.size());
+        if (kv_tracked) {
+            context->kv_tokens.push_back(new_token);
+            context->kv_tokens.insert(context->kv_tokens.end(), draft.begin(), draft.end());
+        }
+    }
+    
+    auto end_time = std::chrono::steady_clock::now();
+    last_info.prompt_ms = std::chrono::duration<double, std::milli>(prompt_done_time - start_time).count();
+    last_info.generation_ms = std::chrono::duration<double, std::milli>(end_time - prompt_done_time).count();
+    
+    return response;
+}
+
+/**
+ * Generate n completions of one prompt in parallel
+ * The prompt is decoded once into sequence 0 and its KV cells are shared with sequences
+ * 1..n-1 through seq_cp, so each extra completion costs only its own generated tokens.
+ * Every step decodes one token per unfinished completion in a single batch.
+ */
+std::vector<std::string> LlamaInterface::generateN(const std::string& prompt, int n, int max_tokens) {
+    TraceSpan span("LlamaInterface::generateN");
+    span.arg("n", n);
+    if (!model || !model->model || !context || !context->ctx) {
+        throw std::runtime_error("Model not properly initialized");
+    }
+    
+    if (prompt.empty()) {
+        throw std::runtime_error("Prompt cannot be empty");
+    }
+    
+    if (max_tokens <= 0 || max_tokens > 4096) {
+        throw std::runtime_error("max_tokens must be between 1 and 4096");
+    }
+    
+    const int n_seq = static_cast<int>(llama_n_seq_max(context->ctx));
+    if (n < 1 || n > n_seq) {
+        throw std::runtime_error("n must be between 1 and " + std::to_string(n_seq));
+    }
+    
+    const auto vocab = llama_model_get_vocab(model->model);
+    const int n_ctx = static_cast<int>(llama_n_ctx(context->ctx));
+    
+    std::vector<llama_token> tokens = tokenize(prompt, true);
+    const int n_tokens = static_cast<int>(tokens.size());
+    if (n_tokens + n > n_ctx) {
+        throw std::runtime_error("Prompt is " + std::to_string(n_tokens) + " tokens but the context window is " +
+                                 std::to_string(n_ctx));
+    }
+    
+    last_info = GenerationInfo();
+    last_info.prompt_tokens = n_tokens;
+    
+    auto pool_lock = lockThreadPool();
+    auto start_time = std::chrono::steady_clock::now();
+    
+    llama_kv_self_clear(context->ctx);
+    context->kv_tokens.clear();
+    context->generations++;
+    
+    std::vector<std::string> responses(n);
+    last_info.completion_stop_reasons.assign(n, "");
+    
+    std::string interrupted = prefill(tokens);
+    if (!interrupted.empty()) {
+        last_info.stop_reason = interrupted;
+        last_info.completion_stop_reasons.assign(n, interrupted);
+        last_info.prompt_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start_time).count();
+        return responses;
+    }
+    
+    auto prompt_done_time = std::chrono::steady_clock::now();
+    
+    // Independent samplers; with a fixed seed each completion gets its own offset of it
+    std::vector<std::unique_ptr<LlamaSampler>> samplers;
+    for (int i = 0; i < n; i++) {
+        if (i > 0) {
+            llama_kv_self_seq_cp(context->ctx, 0, i, -1, -1);
+        }
+        samplers.push_back(buildSampler(temperature, seed == 0xFFFFFFFF ? seed : seed + i));
+    }
+    
+    // Batch index of each completion's logits; all completions start from the prompt's last position
+    std::vector<int32_t> logits_index(n, -1);
+    std::vector<bool> running(n, true);
+    int n_running = n;
+    int kv_used = n_tokens;
+    llama_pos pos = n_tokens;
+    LlamaBatch batch(n, 1);
+    
+    auto stopAll = [&](const std::string& reason) {
+        for (int i = 0; i < n; i++) {
+            if (running[i]) {
+                running[i] = false;
+                last_info.completion_stop_reasons[i] = reason;
+            }
+        }
+        last_info.stop_reason = reason;
+        n_running = 0;
+    };
+    
+    while (n_running > 0) {
+        batch.clear();
+        for (int i = 0; i < n; i++) {
+            if (!running[i]) {
+                continue;
+            }
+            
+            llama_token token = sampleToken(*samplers[i], logits_index[i]);
+            if (llama_vocab_is_eog(vocab, token)) {
+                running[i] = false;
+                n_running--;
+                last_info.completion_stop_reasons[i] = last_info.stop_reason = "eos";
+                continue;
+            }
+            
+            responses[i] += tokenToPiece(token);
+            last_info.generated_tokens++;
+            if (static_cast<int>(pos) - n_tokens + 1 >= max_tokens) {
+                running[i] = false;
+                n_running--;
+                last_info.completion_stop_reasons[i] = last_info.stop_reason = "max_tokens";
+                continue;
+            }
+            
+            logits_index[i] = batch.batch.n_tokens;
+            batch.add(token, pos, i, true);
+        }
+        
+        if (batch.batch.n_tokens == 0) {
+            break;
+        }
+        
+        if (kv_used + batch.batch.n_tokens > n_ctx) {
+            stopAll("context_full");
+            break;
+        }
+        
+        interrupted = interruptReason();
+        if (!interrupted.empty()) {
+            stopAll(interrupted);
+            break;
+        }
+        
+        TraceSpan decode_span("decode");
+        decode_span.arg("tokens", batch.batch.n_tokens);
+        if (decodeBatch(batch.batch)) {
+            interrupted = interruptReason();
+            stopAll(interrupted.empty() ? "decode_error" : interrupted);
+            break;
+        }
+        kv_used += batch.batch.n_tokens;
+        pos++;
+    }
+    
+    auto end_time = std::chrono::steady_clock::now();
+    last_info.prompt_ms = std::chrono::duration<double, std::milli>(prompt_done_time - start_time).count();
+    last_info.generation_ms = std::chrono::duration<double, std::milli>(end_time - prompt_done_time).count();
+    
+    return responses;
+}
+
+/**
+ * Decode prompt tokens into sequence 0 in n_batch sized chunks
+ * Returns the interrupt reason if the call was stopped, throws if decoding fails
+ */
+std::string LlamaInterface::prefill(const std::vector<llama_token>& tokens, size_t start) {
+    const int n_tokens = static_cast<int>(tokens.size());
+    const int n_batch = static_cast<int>(llama_n_batch(context->ctx));
+    
+    TraceSpan span("prefill");
+    span.arg("tokens", n_tokens - static_cast<int>(start));
+    
+    for (int i = static_cast<int>(start); i < n_tokens; i += n_batch) {
+        std::string interrupted = interruptReason();
+        if (!interrupted.empty()) {
+            return interrupted;
+        }
+        int n_chunk = std::min(n_batch, n_tokens - i);
+        TraceSpan chunk_span("prefill_chunk");
+        chunk_span.arg("tokens", n_chunk);
+        if (decodeBatch(llama_batch_get_one(const_cast<llama_token*>(tokens.data()) + i, n_chunk))) {
+            interrupted = interruptReason(); // An abort inside llama_decode also fails it
+            if (interrupted.empty()) {
+                throw std::runtime_error("Failed to decode prompt");
+            }
+            return interrupted;
+        }
+    }
+    return "";
+}
+
+/**
+ * Score each candidate continuation of `prompt` by its log-probability under the model
+ * The prompt is prefilled once; candidates are forked from its KV cache into parallel
+ * sequences and evaluated together, as many per llama_decode as the batch allows
+ */
+std::vector<CandidateScore> LlamaInterface::score(const std::string& prompt, const std::vector<std::string>& candidates) {
+    TraceSpan span("LlamaInterface::score");
+    if (!model || !model->model || !context || !context->ctx) {
+        throw std::runtime_error("Model not properly initialized");
+    }
+    
+    if (prompt.empty()) {
+        throw std::runtime_error("Prompt cannot be empty");
+    }
+    
+    if (candidates.empty()) {
+        throw std::runtime_error("At least one candidate is required");
+    }
+    
+    const auto vocab = llama_model_get_vocab(model->model);
+    const int n_vocab = llama_vocab_n_tokens(vocab);
+    const int n_ctx = static_cast<int>(llama_n_ctx(context->ctx));
+    const int n_batch = static_cast<int>(llama_n_batch(context->ctx));
+    const int n_seq = static_cast<int>(llama_n_seq_max(context->ctx));
+    
+    std::vector<llama_token> prompt_tokens = tokenize(prompt, true);
+    const int n_prompt = static_cast<int>(prompt_tokens.size());
+    
+    // Candidates are tokenized on their own, as continuations of the prompt
+    std::vector<std::vector<llama_token>> candidate_tokens;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        candidate_tokens.push_back(tokenize(candidates[i], false));
+        int n_candidate = static_cast<int>(candidate_tokens.back().size());
+        if (n_candidate == 0) {
+            throw std::runtime_error("Candidate " + std::to_string(i) + " is empty after tokenization");
+        }
+        if (n_prompt + n_candidate > n_ctx || n_candidate - 1 > n_batch) {
+            throw std::runtime_error("Candidate " + std::to_string(i) + " does not fit the context window");
+        }
+    }
+    
+    std::vector<CandidateScore> scores(candidates.size());
+    auto pool_lock = lockThreadPool();
+    
+    llama_kv_self_clear(context->ctx);
+    context->kv_tokens.clear();
+    std::string interrupted = prefill(prompt_tokens);
+    if (!interrupted.empty()) {
+        throw std::runtime_error("Scoring stopped: " + interrupted);
+    }
+    
+    // Every candidate's first token is predicted by the prompt's last position
+    {
+        const float* logits = llama_get_logits_ith(context->ctx, -1);
+        float lse = logSumExp(logits, n_vocab);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            scores[i].logprob = logits[candidate_tokens[i][0]] - lse;
+            scores[i].tokens = static_cast<int>(candidate_tokens[i].size());
+        }
+    }
+    
+    // The rest are fed in per-candidate sequences forked from the prompt (sequence 0);
+    // the logits at each fed token predict the candidate's next token
+    LlamaBatch batch(n_batch, 1);
+    size_t next = 0;
+    while (next < candidates.size()) {
+        batch.clear();
+        std::vector<std::pair<size_t, int>> group; // Candidate index, batch index of its first token
+        int kv_used = n_prompt;
+        
+        while (next < candidates.size() && static_cast<int>(group.size()) < n_seq - 1) {
+            int n_feed = static_cast<int>(candidate_tokens[next].size()) - 1;
+            if (n_feed == 0) {
+                next++;
+                continue;
+            }
+            if (batch.batch.n_tokens + n_feed > n_batch || kv_used + n_feed > n_ctx) {
+                break;
+            }
+            
+            llama_seq_id seq = static_cast<llama_seq_id>(group.size()) + 1;
+            llama_kv_self_seq_cp(context->ctx, 0, seq, -1, -1);
+            group.emplace_back(next, batch.batch.n_tokens);
+            for (int j = 0; j < n_feed; j++) {
+                batch.add(candidate_tokens[next][j], n_prompt + j, seq, true);
+            }
+            kv_used += n_feed;
+            next++;
+        }
+        
+        if (group.empty()) {
+            continue;
+        }
+        
+        if (decodeBatch(batch.batch)) {
+            interrupted = interruptReason();
+            throw std::runtime_error(interrupted.empty() ? "Failed to decode candidates" : "Scoring stopped: " + interrupted);
+        }
+        
+        for (const auto& member : group) {
+            const auto& tokens = candidate_tokens[member.first];
+            for (size_t j = 1; j < tokens.size(); j++) {
+                const float* logits = llama_get_logits_ith(context->ctx, member.second + static_cast<int>(j) - 1);
+                scores[member.first].logprob += logits[tokens[j]] - logSumExp(logits, n_vocab);
+            }
+        }
+        
+        for (size_t seq = 1; seq <= group.size(); seq++) {
+            llama_kv_self_seq_rm(context->ctx, static_cast<llama_seq_id>(seq), -1, -1);
+        }
+    }
+    
+    for (auto& candidate : scores) {
+        candidate.avg_logprob = candidate.logprob / candidate.tokens;
+    }
+    
+    return scores;
+}
+
+/**
+ * Run a stream of requests through one context with continuous batching
+ * Each active request owns a KV sequence. Every llama_decode carries one token for each
+ * generating sequence plus as many prompt tokens of newly admitted requests as the batch
+ * has room for, so prefill of new work overlaps generation of the rest. A request is only
+ * admitted once its prompt plus max_tokens fits in the free KV cells, so it can never run
+ * out of room mid-generation.
+ */
+void LlamaInterface::generateBatch(int n_parallel, const std::function<bool(BatchRequest&)>& next,
+                                   const std::function<void(const BatchResult&)>& done) {
+    if (!model || !model->model || !context || !context->ctx) {
+        throw std::runtime_error("Model not properly initialized");
+    }
+    
+    const auto vocab = llama_model_get_vocab(model->model);
+    const int n_ctx = static_cast<int>(llama_n_ctx(context->ctx));
+    const int n_batch = static_cast<int>(llama_n_batch(context->ctx));
+    const int n_seq = static_cast<int>(llama_n_seq_max(context->ctx));
+    n_parallel = std::max(1, std::min({n_parallel, n_seq, n_batch}));
+    
+    struct Slot {
+        bool active = false;
+        bool generating = false; // Prompt fully decoded
+        BatchRequest request;
+        BatchResult result;
+        std::vector<llama_token> tokens;
+        size_t n_prefilled = 0;
+        llama_pos n_past = 0;
+        llama_token last_token = 0;
+        int reserved = 0;  // KV cells held for prompt + max_tokens
+        int i_batch = -1;  // Batch index of this step's logits, -1 = none
+        std::unique_ptr<LlamaSampler> sampler;
+    };
+    std::vector<Slot> slots(n_parallel);
+    
+    int kv_reserved = 0;
+    bool exhausted = false;
+    bool has_pending = false;
+    BatchRequest pending; // Pulled but waiting for KV room
+    std::vector<llama_token> pending_tokens;
+    
+    auto finish = [&](Slot& slot, const std::string& stop_reason) {
+        slot.result.stop_reason = stop_reason;
+        done(slot.result);
+        llama_kv_self_seq_rm(context->ctx, static_cast<llama_seq_id>(&slot - slots.data()), -1, -1);
+        kv_reserved -= slot.reserved;
+        slot = Slot();
+    };
+    
+    auto pool_lock = lockThreadPool();
+    llama_kv_self_clear(context->ctx);
+    context->kv_tokens.clear();
+    
+    LlamaBatch batch(n_batch, 1);
+    
+    while (true) {
+        // Admit new requests into free slots while their KV reservation fits
+        for (auto& slot : slots) {
+            if (slot.active) {
+                continue;
+            }
+            while (!has_pending && !exhausted) {
+                if (!next(pending)) {
+                    exhausted = true;
+                    break;
+                }
+                if (pending.prompt.empty() || pending.max_tokens <= 0) {
+                    BatchResult rejected;
+                    rejected.index = pending.index;
+                    rejected.error = "Prompt and max_tokens are required";
+                    done(rejected);
+                    continue;
+                }
+                pending_tokens = tokenize(pending.prompt, true);
+                int need = static_cast<int>(pending_tokens.size()) + pending.max_tokens;
+                if (need > n_ctx) {
+                    BatchResult rejected;
+                    rejected.index = pending.index;
+                    rejected.prompt_tokens = static_cast<int>(pending_tokens.size());
+                    rejected.error = "Prompt plus max_tokens (" + std::to_string(need) +
+                                     ") exceeds the context window of " + std::to_string(n_ctx);
+                    done(rejected);
+                    continue;
+                }
+                has_pending = true;
+            }
+            if (!has_pending) {
+                break;
+            }
+            
+            int need = static_cast<int>(pending_tokens.size()) + pending.max_tokens;
+            if (kv_reserved + need > n_ctx) {
+                break; // Wait for running requests to release their cells
+            }
+            
+            slot.active = true;
+            slot.request = std::move(pending);
+            slot.tokens = std::move(pending_tokens);
+            slot.reserved = need;
+            slot.result.index = slot.request.index;
+            slot.result.prompt_tokens = static_cast<int>(slot.tokens.size());
+            slot.sampler = buildSampler(
+                slot.request.temperature >= 0.0f ? slot.request.temperature : temperature,
+                slot.request.seed >= 0 ? static_cast<uint32_t>(slot.request.seed) : seed);
+            kv_reserved += need;
+            has_pending = false;
+        }
+        
+        // Generating sequences go first so prompt chunks never starve them
+        batch.clear();
+        for (auto& slot : slots) {
+            slot.i_batch = -1;
+            if (slot.active && slot.generating) {
+                slot.i_batch = batch.batch.n_tokens;
+                batch.add(slot.last_token, slot.n_past++, static_cast<llama_seq_id>(&slot - slots.data()), true);
+            }
+        }
+        for (auto& slot : slots) {
+            if (!slot.active || slot.generating) {
+                continue;
+            }
+            llama_seq_id seq = static_cast<llama_seq_id>(&slot - slots.data());
+            while (slot.n_prefilled < slot.tokens.size() && batch.batch.n_tokens < n_batch) {
+                bool last = slot.n_prefilled + 1 == slot.tokens.size();
+                if (last) {
+                    slot.i_batch = batch.batch.n_tokens;
+                }
+                batch.add(slot.tokens[slot.n_prefilled++], slot.n_past++, seq, last);
+            }
+        }
+        
+        if (batch.batch.n_tokens == 0) {
+            break; // Nothing active and nothing left to admit
+        }
+        
+        // Decode the batch in views; when the KV cache has no room for a view it is halved
+        // and retried, and only the requests in a view that fails at one token are dropped
+        std::vector<bool> failed(slots.size(), false);
+        const int n_tokens = batch.batch.n_tokens;
+        int n_view = n_tokens;
+        for (int i = 0; i < n_tokens;) {
+            const int n = std::min(n_view, n_tokens - i);
+            llama_batch view = batch.batch;
+            view.n_tokens = n;
+            view.token += i;
+            view.pos += i;
+            view.n_seq_id += i;
+            view.seq_id += i;
+            view.logits += i;
+            
+            int status = decodeBatch(view);
+            if (status == 1 && n > 1) {
+                n_view = n / 2;
+                continue;
+            }
+            if (status != 0) {
+                for (int j = i; j < i + n; j++) {
+                    failed[batch.batch.seq_id[j][0]] = true;
+                }
+                i += n;
+                continue;
+            }
+            
+            for (auto& slot : slots) {
+                size_t seq = &slot - slots.data();
+                if (!slot.active || failed[seq] || slot.i_batch < i || slot.i_batch >= i + n) {
+                    continue;
+                }
+                slot.generating = true;
+                
+                // Logits are indexed within the view that produced them
+                llama_token token = sampleToken(*slot.sampler, slot.i_batch - i);
+                if (llama_vocab_is_eog(vocab, token)) {
+                    finish(slot, "eos");
+                    continue;
+                }
+                
+                slot.result.text += tokenToPiece(token);
+                slot.result.generated_tokens++;
+                if (slot.result.generated_tokens >= slot.request.max_tokens) {
+                    finish(slot, "max_tokens");
+                    continue;
+                }
+                slot.last_token = token;
+            }
+            i += n;
+        }
+        
+        // Dropped only once the whole batch is done, so none of their cells are decoded into after seq_rm
+        for (auto& slot : slots) {
+            if (slot.active && failed[&slot - slots.data()]) {
+                finish(slot, "decode_error");
+            }
+        }
+    }
+}
+
+std::vector<llama_token> LlamaInterface::tokenize(const std::string& text, bool add_special) {
+    const auto vocab = llama_model_get_vocab(model->model);
+    std::vector<llama_token> tokens(text.length() + 2);
+    int n_tokens = llama_tokenize(vocab, text.c_str(), text.length(),
+                                  tokens.data(), tokens.size(), add_special, true);
+    if (n_tokens < 0) {
+        throw std::runtime_error("Failed to tokenize text");
+    }
+    tokens.resize(n_tokens);
+    return tokens;
+}
+
+std::string LlamaInterface::tokenToPiece(llama_token token) {
+    const auto vocab = llama_model_get_vocab(model->model);
+    char piece[256];
+    int length = llama_token_to_piece(vocab, token, piece, sizeof(piece), 0, true);
+    if (length < 0) {
+        // Longer than the stack buffer; -length is the size needed
+        std::string long_piece(-length, '\0');
+        llama_token_to_piece(vocab, token, &long_piece[0], -length, 0, true);
+        return long_piece;
+    }
+    return std::string(piece, length);
+}
+
+/**
+ * Under the serialize policy the shared threadpool is held for a whole generation
+ */
+std::unique_lock<std::mutex> LlamaInterface::lockThreadPool() {
+    if (context->threadpool && getThreadPoolPolicy() == ThreadPoolPolicy::SERIALIZE) {
+        return std::unique_lock<std::mutex>(context->threadpool->compute_mutex);
+    }
+    return std::unique_lock<std::mutex>();
+}
+
+void LlamaInterface::setTopLogprobs(int k) {
+    top_logprobs = k;
+}
+
+void LlamaInterface::setPromptLookup(int n_draft, int ngram) {
+    lookup_draft = std::max(0, n_draft);
+    lookup_ngram = std::max(1, ngram);
+}
+
+/**
+ * Sample the next token from the logits at batch index `idx` (-1 = last)
+ */
+llama_token LlamaInterface::sampleToken(int32_t idx) {
+    return sampleToken(*sampler, idx);
+}
+
+llama_token LlamaInterface::sampleToken(LlamaSampler& sampler, int32_t idx) {
+    if (sampler.greedy) {
+        // Argmax over the raw logits - no candidate array, softmax or sort
+        const int n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model->model));
+        const float* logits = llama_get_logits_ith(context->ctx, idx);
+        return static_cast<llama_token>(std::max_element(logits, logits + n_vocab) - logits);
+    }
+    
+    return llama_sampler_sample(sampler.chain, context->ctx, idx);
+}
+
+void LlamaInterface::setContextShift(bool enabled, int n_keep) {
+    if (!context || !context->ctx) {
+        throw std::runtime_error("Model not properly initialized");
+    }
+    
+    // Pinning more than a quarter of the window would leave too little to slide
+    int max_keep = static_cast<int>(llama_n_ctx(context->ctx)) / 4;
+    if (n_keep < 0 || n_keep > max_keep) {
+        throw std::invalid_argument("keep must be between 0 and " + std::to_string(max_keep) +
+                                    " (a quarter of the context window), got: " + std::to_string(n_keep));
+    }
+    
+    context_shift = enabled;
+    keep_tokens = n_keep;
+}
+
+void LlamaInterface::setDeadline(std::chrono::steady_clock::time_point deadline) {
+    deadline_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+}
+
+void LlamaInterface::clearDeadline() {
+    deadline_ns = 0;
+    abort_requested = false;
+}
+
+void LlamaInterface::setStopCheck(std::function<bool()> check) {
+    stop_check = std::move(check);
+}
+
+void LlamaInterface::abort() {
+    abort_requested = true;
+}
+
+/**
+ * llama.cpp abort callback, polled inside llama_decode between graph nodes
+ * It may run on a compute thread, so only the atomics are consulted here
+ */
+bool LlamaInterface::onAbort(void* user_data) {
+    auto* self = static_cast<LlamaInterface*>(user_data);
+    if (self->abort_requested) {
+        return true;
+    }
+    int64_t deadline = self->deadline_ns;
+    return deadline != 0 && steadyNowNs() >= deadline;
+}
+
+/**
+ * Why the current call should stop, or an empty string to continue
+ * Runs on the calling thread, so the stop check may call back into PHP
+ */
+std::string LlamaInterface::interruptReason() {
+    if (!abort_requested && stop_check && stop_check()) {
+        abort_requested = true;
+    }
+    if (abort_requested) {
+        return "aborted";
+    }
+    int64_t deadline = deadline_ns;
+    if (deadline != 0 && steadyNowNs() >= deadline) {
+        return "timeout";
+    }
+    return "";
+}
+
+GenerationInfo LlamaInterface::getLastGenerationInfo() const {
+    return last_info;
+}
+
+/**
+ * Run llama_decode, taking turns on the shared threadpool under the interleave policy
+ * (under the serialize policy generate() already holds it)
+ */
+int LlamaInterface::decodeBatch(const llama_batch& batch) {
+    std::unique_lock<std::mutex> pool_lock;
+    if (context->threadpool && getThreadPoolPolicy() == ThreadPoolPolicy::INTERLEAVE) {
+        pool_lock = std::unique_lock<std::mutex>(context->threadpool->compute_mutex);
+    }
+    
+    return llama_decode(context->ctx, batch);
+}
+
+bool LlamaInterface::hasPenalties() const {
+    return penalty_last_n != 0 &&
+        (repeat_penalty != 1.0f || frequency_penalty != 0.0f || presence_penalty != 0.0f);
+}
+
+void LlamaInterface::rebuildSampler() {
+    sampler = buildSampler(temperature, seed);
+    sampler_dirty = false;
+}
+
+/**
+ * Build a sampler chain from the current parameters, with the given temperature and seed
+ * Samplers that would be no-ops are left out so their per-token cost is not paid
+ */
+std::unique_ptr<LlamaSampler> LlamaInterface::buildSampler(float temperature, uint32_t seed) const {
+    auto sampler = std::make_unique<LlamaSampler>();
+    
+    if (temperature <= 0.0f && !hasPenalties()) {
+        sampler->greedy = true;
+        return sampler;
+    }
+    
+    sampler->chain = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    
+    if (hasPenalties()) {
+        llama_sampler_chain_add(sampler->chain, llama_sampler_init_penalties(
+            penalty_last_n, repeat_penalty, frequency_penalty, presence_penalty));
+    }
+    
+    if (temperature <= 0.0f) {
+        llama_sampler_chain_add(sampler->chain, llama_sampler_init_greedy());
+        return sampler;
+    }
+    
+    if (top_k > 0) {
+        llama_sampler_chain_add(sampler->chain, llama_sampler_init_top_k(top_k));
+    }
+    if (top_p < 1.0f) {
+        llama_sampler_chain_add(sampler->chain, llama_sampler_init_top_p(top_p, 1));
+    }
+    if (min_p > 0.0f) {
+        llama_sampler_chain_add(sampler->chain, llama_sampler_init_min_p(min_p, 1));
+    }
+    llama_sampler_chain_add(sampler->chain, llama_sampler_init_temp(temperature));
+    llama_sampler_chain_add(sampler->chain, llama_sampler_init_dist(seed));
+    return sampler;
+}
+
+void LlamaInterface::setTemperature(float temperature) {
+    this->temperature = temperature;
+    sampler_dirty = true;
+}
+
+void LlamaInterface::setTopP(float top_p) {
+    this->top_p = top_p;
+    sampler_dirty = true;
+}
+
+void LlamaInterface::setTopK(int top_k) {
+    this->top_k = top_k;
+    sampler_dirty = true;
+}
+
+void LlamaInterface::setMinP(float min_p) {
+    this->min_p = min_p;
+    sampler_dirty = true;
+}
+
+void LlamaInterface::setRepeatPenalty(float penalty, int last_n) {
+    repeat_penalty = penalty;
+    penalty_last_n = last_n;
+    sampler_dirty = true;
+}
+
+void LlamaInterface::setFrequencyPenalty(float penalty) {
+    frequency_penalty = penalty;
+    sampler_dirty = true;
+}
+
+void LlamaInterface::setPresencePenalty(float penalty) {
+    presence_penalty = penalty;
+    sampler_dirty = true;
+}
+
+void LlamaInterface::setSeed(uint32_t seed) {
+    this->seed = seed;
+    sampler_dirty = true;
+}
+
+void LlamaInterface::clearCache() {
+    if (context && context->ctx) {
+        llama_kv_self_clear(context->ctx);
+        context->kv_tokens.clear();
+    }
+}
+
+void LlamaInterface::setAutoClearCache(uint64_t generations) {
+    auto_clear_cache = generations;
+}
+
+void LlamaInterface::setCacheScope(const std::string& scope) {
+    cache_scope = scope;
+}
+
+std::string LlamaInterface::getCacheScope() const {
+    return cache_scope;
+}
+
+/**
+ * Forget a pooled context's KV cache and chat history when they were left by another
+ * cache scope, so neither the cells nor prompt_tokens_cached reveal someone else's prompts
+ */
+void LlamaInterface::enterCacheScope() {
+    if (context->kv_scope == cache_scope) {
+        return;
+    }
+    llama_kv_self_clear(context->ctx);
+    context->kv_tokens.clear();
+    context->chat_prompt.clear();
+    context->chat_tokens.clear();
+    context->kv_scope = cache_scope;
+}
+
+/**
+ * Load a LoRA adapter on top of the base model, or reuse it if already loaded
+ * Adapters live with the (cached) model, so other instances on the same base see them too
+ */
+std::string LlamaInterface::loadAdapter(const std::string& path, float scale, const std::string& name) {
+    if (!model || !model->model) {
+        throw std::runtime_error("Model not properly initialized");
+    }
+    
+    if (!std::filesystem::is_regular_file(path)) {
+        throw std::runtime_error("Adapter file not found: " + path);
+    }
+    
+    std::string adapter_name = name.empty() ? std::filesystem::path(path).stem().string() : name;
+    
+    std::lock_guard<std::mutex> lock(model->adapters_mutex);
+    
+    auto existing = model->adapters.find(adapter_name);
+    if (existing != model->adapters.end()) {
+        if (existing->second.path != path) {
+            throw std::runtime_error("Adapter name '" + adapter_name + "' is already used by " + existing->second.path);
+        }
+        existing->second.scale = scale;
+        return adapter_name;
+    }
+    
+    // The same file may already be loaded under another name
+    for (const auto& entry : model->adapters) {
+        if (entry.second.path == path) {
+            model->adapters[adapter_name] = {entry.second.adapter, path, scale};
+            return adapter_name;
+        }
+    }
+    
+    llama_adapter_lora* adapter = llama_adapter_lora_init(model->model, path.c_str());
+    if (!adapter) {
+        throw std::runtime_error("Failed to load adapter (incompatible with the base model?): " + path);
+    }
+    
+    model->adapters[adapter_name] = {adapter, path, scale};
+    return adapter_name;
+}
+
+/**
+ * Switch the context to a loaded adapter (or back to the base model) without reloading weights
+ */
+void LlamaInterface::useAdapter(const std::string& name, std::optional<float> scale) {
+    if (!context || !context->ctx) {
+        throw std::runtime_error("Model not properly initialized");
+    }
+    
+    if (name.empty()) {
+        if (!active_adapter.empty()) {
+            llama_clear_adapter_lora(context->ctx);
+            active_adapter.clear();
+            context->kv_tokens.clear(); // Cached cells were computed with the adapter
+        }
+        return;
+    }
+    
+    llama_adapter_lora* adapter = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(model->adapters_mutex);
+        auto found = model->adapters.find(name);
+        if (found == model->adapters.end()) {
+            throw std::runtime_error("Adapter not loaded: " + name);
+        }
+        adapter = found->second.adapter;
+        if (!scale) {
+            scale = found->second.scale;
+        }
+    }
+    
+    if (name == active_adapter && *scale == active_adapter_scale) {
+        return;
+    }
+    
+    llama_clear_adapter_lora(context->ctx);
+    context->kv_tokens.clear();
+    if (llama_set_adapter_lora(context->ctx, adapter, *scale) != 0) {
+        active_adapter.clear();
+        throw std::runtime_error("Failed to apply adapter: " + name);
+    }
+    
+    active_adapter = name;
+    active_adapter_scale = *scale;
+}
+
+std::string LlamaInterface::getActiveAdapter() const {
+    return active_adapter;
+}
+
+float LlamaInterface::getActiveAdapterScale() const {
+    return active_adapter_scale;
+}
+
+std::vector<LlamaInterface::AdapterInfo> LlamaInterface::getAdapters() const {
+    std::vector<AdapterInfo> adapters;
+    if (!model || !model->model) {
+        return adapters;
+    }
+    
+    std::lock_guard<std::mutex> lock(model->adapters_mutex);
+    for (const auto& entry : model->adapters) {
+        adapters.push_back({entry.first, entry.second.path, entry.second.scale});
+    }
+    
+    return adapters;
+}
+
+void LlamaInterface::setHardwareConfig(const HardwareConfig& config) {
+    hardware_config = config;
+}
+
+HardwareConfig LlamaInterface::getHardwareConfig() const {
+    return hardware_config;
+}
+
+int LlamaInterface::detectGPUCount() {
+    // Try to get GPU count from nvidia-smi
+    FILE* pipe = popen("nvidia-smi --query-gpu=count --format=csv,noheader,nounits 2>/dev/null | wc -l", "r");
+    if (pipe) {
+        char buffer[32];
+        if (fgets(buffer, sizeof(buffer), pipe)) {
+            int count = std::atoi(buffer);
+            pclose(pipe);
+            return count;
+        }
+        pclose(pipe);
+    }
+    
+    // Fallback: try to detect via /proc
+    std::ifstream nvidia_smi("/proc/driver/nvidia/gpus");
+    if (!nvidia_smi.is_open()) {
+        return 0; // No NVIDIA driver or GPUs
+    }
+    
+    int gpu_count = 0;
+    std::string line;
+    while (std::getline(nvidia_smi, line)) {
+        if (line.find("GPU-") != std::string::npos) {
+            gpu_count++;
+        }
+    }
+    
+    return gpu_count;
+}
+
+std::vector<std::string> LlamaInterface::getGPUInfo() {
+    std::vector<std::string> gpu_info;
+    
+    // Try to get GPU info from nvidia-ml-py or nvidia-smi
+    FILE* pipe = popen("nvidia-smi --query-gpu=name,memory.total --format=csv,noheader,nounits 2>/dev/null", "r");
+    if (pipe) {
+        char buffer[256];
+        while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+            std::string line(buffer);
+            if (!line.empty() && line.back() == '\n') {
+                line.pop_back();
+            }
+            if (!line.empty()) {
+                gpu_info.push_back(line);
+            }
+        }
+        pclose(pipe);
+    }
+    
+    return gpu_info;
+}
+
+int LlamaInterface::getOptimalCPUThreads() {
+    int total_cores = std::thread::hardware_concurrency();
+    
+    // For dual Xeon setup, we want to use most cores but leave some for system
+    if (total_cores >= 16) {
+        return total_cores - 2; // Leave 2 cores for system
+    } else if (total_cores >= 8) {
+        return total_cores - 1; // Leave 1 core for system
+    } else {
+        return std::max(1, total_cores / 2);
+    }
+}
+
+int LlamaInterface::detectNumaNodeCount() {
+    int node_count = 0;
+    while (std::filesystem::exists("/sys/devices/system/node/node" + std::to_string(node_count))) {
+        node_count++;
+    }
+    return std::max(1, node_count);
+}
+
+std::vector<int> LlamaInterface::getNumaNodeCPUs(int node) {
+    std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!cpulist.is_open()) {
+        return {};
+    }
+    
+    std::string line;
+    std::getline(cpulist, line);
+    return parseCPUList(line);
+}
+
+/**
+ * Parse a Linux CPU list such as "0-15,32-47" into individual CPU ids
+ */
+std::vector<int> LlamaInterface::parseCPUList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream stream(list);
+    std::string range;
+    
+    while (std::getline(stream, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty()) {
+            continue;
+        }
+        
+        try {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            if (first < 0 || last < first || last >= GGML_MAX_N_THREADS) {
+                throw std::invalid_argument("CPU range out of bounds: " + range);
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::logic_error&) {
+            throw std::invalid_argument("Invalid CPU list: " + list);
+        }
+    }
+    
+    return cpus;
+}
+
+void LlamaInterface::setThreadPoolConfig(int size, ThreadPoolPolicy policy) {
+    std::lock_guard<std::mutex> lock(pools_mutex);
+    thread_pool_size = size;
+    thread_pool_policy = policy;
+}
+
+int LlamaInterface::getThreadPoolSize() {
+    std::lock_guard<std::mutex> lock(pools_mutex);
+    return thread_pool_size;
+}
+
+ThreadPoolPolicy LlamaInterface::getThreadPoolPolicy() {
+    std::lock_guard<std::mutex> lock(pools_mutex);
+    return thread_pool_policy;
 }
 
 HardwareConfig LlamaInterface::detectOptimalConfig() {
@@ -4,6 +4,12 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <mutex>
+#include <chrono>
 
 // GPU Configuration options
 enum class GPUMode {
@@ -13,6 +19,15 @@ enum class GPUMode {
     AUTO = -1
 };
 
+// NUMA strategies, mirroring ggml_numa_strategy
+enum class NumaStrategy {
+    DISABLED = 0,
+    DISTRIBUTE = 1, // Spread threads evenly across nodes
+    ISOLATE = 2,    // Keep threads on the node the process starts on (or numa_node)
+    NUMACTL = 3,    // Use the CPU map provided by numactl
+    MIRROR = 4      // Not implemented by ggml; rejected by the ini/config parser
+};
+
 struct HardwareConfig {
     GPUMode gpu_mode = GPUMode::AUTO;
     int gpu_layers = -1;  // -1 = auto-detect
@@ -20,34 +35,208 @@ struct HardwareConfig {
     bool use_mmap = true;
     bool use_mlock = false;
     int cpu_threads = -1; // -1 = auto-detect
+    int prefill_threads = -1; // Prompt processing threads, -1 = cpu_threads
+    int decode_threads = -1;  // Token generation threads, -1 = cpu_threads
+    NumaStrategy numa = NumaStrategy::DISABLED; // Applied once per process
+    int numa_node = -1;       // Node to isolate to, -1 = current node
+    std::vector<int> cpu_affinity; // CPUs compute threads are pinned to, empty = unpinned
+    int context_size = 2048;  // n_ctx
+    int batch_size = 512;     // n_batch, prompt tokens decoded per llama_decode call
+    int prefetch_threads = 0; // Threads streaming the file into the page cache before load, 0 = off
     bool tensor_split_enabled = false;
     std::vector<float> tensor_split;
 };
 
+// Log-probability of a generated token and its most likely alternatives
+struct TokenLogprob {
+    std::string token;
+    float logprob = 0.0f;
+    std::vector<std::pair<std::string, float>> top; // Highest first
+};
+
+// Log-probability of a candidate continuation under score()
+struct CandidateScore {
+    float logprob = 0.0f;     // Sum over the candidate's tokens
+    float avg_logprob = 0.0f; // Length-normalized
+    int tokens = 0;
+};
+
+// Summary of the most recent generate() call
+struct GenerationInfo {
+    int prompt_tokens = 0;
+    int prompt_tokens_truncated = 0; // Dropped from the middle of an oversized prompt
+    int prompt_tokens_cached = 0;    // Reused from the KV cache instead of prefilled
+    int generated_tokens = 0;
+    int context_shifts = 0;
+    std::string stop_reason;         // eos, max_tokens, context_full, complete, timeout, aborted or decode_error
+    double prompt_ms = 0.0;
+    double generation_ms = 0.0;
+    std::vector<TokenLogprob> logprobs; // Only filled when top logprobs are requested
+    std::vector<std::string> completion_stop_reasons; // Per completion of generateN()
+    int draft_tokens = 0;   // Prompt lookup tokens proposed
+    int draft_accepted = 0; // Of which the model agreed with
+};
+
+// One turn of a conversation passed to chat()
+struct ChatMessage {
+    std::string role;    // system, user or assistant
+    std::string content;
+};
+
+// One prompt of an offline batch job
+struct BatchRequest {
+    size_t index = 0;          // Caller's id, echoed in the result
+    std::string prompt;
+    int max_tokens = 512;
+    float temperature = -1.0f; // < 0 = instance setting
+    int64_t seed = -1;         // < 0 = instance setting
+};
+
+struct BatchResult {
+    size_t index = 0;
+    std::string text;
+    std::string error;         // Set when the request was rejected without generating
+    int prompt_tokens = 0;
+    int generated_tokens = 0;
+    std::string stop_reason;   // eos, max_tokens or decode_error
+};
+
+// How Phllama instances sharing the process-wide thread pool take turns
+enum class ThreadPoolPolicy {
+    INTERLEAVE = 0, // Alternate per decode step
+    SERIALIZE = 1   // Run whole generations one at a time
+};
+
 struct LlamaContext;
 struct LlamaModel;
+struct LlamaSampler;
+struct llama_batch;
 
 class LlamaInterface {
 private:
-    std::unique_ptr<LlamaModel> model;
-    std::unique_ptr<LlamaContext> context;
+    std::shared_ptr<LlamaModel> model; // Shared through ModelCache
+    std::shared_ptr<LlamaContext> context; // Checked out of ContextPool, returned on destruction
     std::string model_path;
-    float temperature = 0.7f;
+    std::unique_ptr<LlamaSampler> sampler; // Rebuilt only when sampling parameters change
+    bool sampler_dirty = true;
+    float temperature = 0.7f; // 0 = greedy
     float top_p = 0.9f;
-    int top_k = 40;
+    int top_k = 40;           // <= 0 disables top-k
+    float min_p = 0.0f;
+    float repeat_penalty = 1.0f;
+    float frequency_penalty = 0.0f;
+    float presence_penalty = 0.0f;
+    int penalty_last_n = 64;
+    uint32_t seed = 0xFFFFFFFF; // LLAMA_DEFAULT_SEED = random
+    bool context_shift = false; // Slide the window instead of stopping when n_ctx is reached
+    int keep_tokens = 0;        // Leading tokens (e.g. system prompt) never shifted out
+    int top_logprobs = 0;       // Alternatives recorded per generated token, 0 = logprobs off
+    int lookup_draft = 0;       // Prompt lookup tokens drafted per decode step, 0 = off
+    int lookup_ngram = 3;       // Longest n-gram matched against earlier tokens
+    uint64_t auto_clear_cache = 0; // Clear the KV cache every this many generations of the context, 0 = never
+    std::string cache_scope;    // Preserved KV of a pooled context is only reused within one scope
+    std::string active_adapter; // LoRA adapter applied to the context, empty = base model
+    float active_adapter_scale = 0.0f;
     HardwareConfig hardware_config;
+    GenerationInfo last_info;
+    std::atomic<float> load_progress{0.0f};
+    std::atomic<bool> load_cancelled{false};
+    std::atomic<int64_t> deadline_ns{0};    // steady_clock deadline of the current call, 0 = none
+    std::atomic<bool> abort_requested{false};
+    std::function<bool()> stop_check;       // Polled between decode steps on the calling thread
     
+    static bool onLoadProgress(float progress, void* user_data);
+    static bool onAbort(void* user_data);
+    std::string interruptReason();
+    void releaseContext();
+    std::string prefill(const std::vector<int32_t>& tokens, size_t start = 0); // Into sequence 0; returns an interrupt reason or ""
+    std::string generateTokens(std::vector<int32_t> tokens, int max_tokens,
+                               const std::function<bool(const std::string&)>& on_piece);
+    std::string applyChatTemplate(const std::vector<ChatMessage>& messages, bool add_assistant);
+    std::vector<int32_t> tokenizeAppended(const std::string& prompt); // Empty = tokenize the whole prompt
+    void enterCacheScope();
+    
+    bool hasPenalties() const;
+    void rebuildSampler();
+    std::unique_ptr<LlamaSampler> buildSampler(float temperature, uint32_t seed) const;
+    int decodeBatch(const llama_batch& batch);
+    std::unique_lock<std::mutex> lockThreadPool();
+    std::vector<int32_t> tokenize(const std::string& text, bool add_special);
+    std::string tokenToPiece(int32_t token);
+    int32_t sampleToken(int32_t idx);
+    int32_t sampleToken(LlamaSampler& sampler, int32_t idx);
+
 public:
     LlamaInterface();
     ~LlamaInterface();
     
     bool loadModel(const std::string& path);
     bool loadModel(const std::string& path, const HardwareConfig& config);
-    std::string generate(const std::string& prompt, int max_tokens = 512);
+    float getLoadProgress() const; // 0.0 - 1.0, safe to call while loadModel runs on another thread
+    void cancelLoad();             // Makes an in-flight loadModel fail as soon as possible
+    static void prefetchFile(const std::string& path, int n_threads,
+                             const std::function<void(float)>& progress = nullptr);
+    // on_piece sees each token's text as it is produced; returning false stops with reason "complete"
+    std::string generate(const std::string& prompt, int max_tokens = 512,
+                         const std::function<bool(const std::string&)>& on_piece = nullptr);
+    
+    // Reply to a conversation using the model's chat template; the tokenized history and its
+    // KV cells are reused, so each turn only processes the newly appended messages
+    std::string chat(const std::vector<ChatMessage>& messages, int max_tokens = 512,
+                     const std::function<bool(const std::string&)>& on_piece = nullptr);
+    
+    // n sampled completions of one prompt: prefilled once, forked into n KV sequences and
+    // decoded together with an independent sampler per completion
+    std::vector<std::string> generateN(const std::string& prompt, int n, int max_tokens = 512);
     void setTemperature(float temperature);
     void setTopP(float top_p);
     void setTopK(int top_k);
+    void setMinP(float min_p);
+    void setRepeatPenalty(float penalty, int last_n = 64);
+    void setFrequencyPenalty(float penalty);
+    void setPresencePenalty(float penalty);
+    void setSeed(uint32_t seed);
     void clearCache(); // Clear KV cache for memory management
+    void setAutoClearCache(uint64_t generations); // 0 = never
+    
+    // Pooled contexts only reuse KV cells left by the same scope; defaults to one per instance
+    void setCacheScope(const std::string& scope);
+    std::string getCacheScope() const;
+    void setContextShift(bool enabled, int n_keep = 0);
+    void setTopLogprobs(int k);
+    
+    // Prompt lookup decoding: the continuation of the latest n-gram's previous occurrence in the
+    // prompt or output is verified as a draft in the same decode; output is unchanged
+    void setPromptLookup(int n_draft, int ngram = 3);
+    
+    // Cancellation: checked between decode steps and, through llama's abort callback, inside
+    // llama_decode. An interrupted generate() returns its partial output with stop reason
+    // "timeout" or "aborted".
+    void setDeadline(std::chrono::steady_clock::time_point deadline);
+    void clearDeadline();
+    void setStopCheck(std::function<bool()> check); // Empty function = none
+    void abort(); // Thread-safe; stops the current or next call
+    
+    // Score candidate continuations of a prompt in one batched forward pass, without generating
+    std::vector<CandidateScore> score(const std::string& prompt, const std::vector<std::string>& candidates);
+    GenerationInfo getLastGenerationInfo() const;
+    
+    // Continuous batching over up to n_parallel KV sequences: `next` is pulled whenever a
+    // sequence frees up (returns false once exhausted) and `done` runs as each request finishes
+    void generateBatch(int n_parallel, const std::function<bool(BatchRequest&)>& next,
+                       const std::function<void(const BatchResult&)>& done);
+    
+    // LoRA adapters are loaded once per base model and shared by every instance using it
+    struct AdapterInfo {
+        std::string name;
+        std::string path;
+        float scale = 1.0f;
+    };
+    std::string loadAdapter(const std::string& path, float scale, const std::string& name = "");
+    void useAdapter(const std::string& name, std::optional<float> scale = std::nullopt); // Empty name = base model, no scale = adapter default
+    std::string getActiveAdapter() const;
+    float getActiveAdapterScale() const; // Scale the active adapter was applied with
+    std::vector<AdapterInfo> getAdapters() const;
     
     // Hardware configuration methods
     void setHardwareConfig(const HardwareConfig& config);
@@ -55,8 +244,17 @@ public:
     static int detectGPUCount();
     static std::vector<std::string> getGPUInfo();
     static int getOptimalCPUThreads();
+    static int detectNumaNodeCount();
+    static std::vector<int> getNumaNodeCPUs(int node);
+    static std::vector<int> parseCPUList(const std::string& list);
     static HardwareConfig detectOptimalConfig();
     
+    // Process-wide compute thread pool shared by every context
+    // size: -1 = auto, 0 = disabled (each context spawns its own threads)
+    static void setThreadPoolConfig(int size, ThreadPoolPolicy policy);
+    static int getThreadPoolSize();
+    static ThreadPoolPolicy getThreadPoolPolicy();
+    
     // Performance monitoring
     struct PerformanceStats {
         double tokens_per_second = 0.0;
@@ -1,12 +1,180 @@
 #include <phpcpp.h>
 #include <iostream>
 #include <string>
+#include <fstream>
 #include <memory>
 #include <filesystem>
 #include <regex>
 #include <cmath>
+#include <cctype>
+#include <future>
+#include <chrono>
+#include <algorithm>
 #include "ollama_interface.h"
 #include "llama_interface.h"
+#include "model_cache.h"
+#include "context_pool.h"
+#include "gguf_reader.h"
+#include "quantizer.h"
+#include "admission_control.h"
+#include "trace.h"
+#include "json_util.h"
+
+// PHP internals used directly: PG(connection_status) and php_check_open_basedir_ex()
+#include <php.h>
+
+/**
+ * Copy GGUF header metadata into a PHP array
+ */
+static void addModelMetadata(Php::Array& info, const GGUFInfo& gguf)
+{
+    info["architecture"] = gguf.architecture;
+    info["name"] = gguf.name;
+    info["parameters"] = static_cast<int64_t>(gguf.parameter_count);
+    info["quantization"] = gguf.quantization;
+    info["context_length"] = gguf.context_length;
+    info["embedding_length"] = gguf.embedding_length;
+    info["block_count"] = gguf.block_count;
+    info["head_count"] = gguf.head_count;
+    info["vocab_size"] = gguf.vocab_size;
+    info["file_size"] = static_cast<int64_t>(gguf.file_size);
+    info["gguf_version"] = static_cast<int64_t>(gguf.version);
+}
+
+/**
+ * Parse a byte count with an optional K/M/G suffix (e.g. "8G"), as PHP does for memory_limit
+ */
+static size_t parseByteSize(const std::string& value)
+{
+    if (value.empty()) {
+        return 0;
+    }
+    
+    size_t consumed = 0;
+    long long bytes = 0;
+    try {
+        bytes = std::stoll(value, &consumed);
+    } catch (const std::exception&) {
+        return 0;
+    }
+    
+    if (bytes <= 0) {
+        return 0;
+    }
+    
+    if (consumed < value.length()) {
+        switch (std::toupper(static_cast<unsigned char>(value[consumed]))) {
+            case 'G': bytes *= 1024;  // fall through
+            case 'M': bytes *= 1024;  // fall through
+            case 'K': bytes *= 1024;  break;
+            default: break;
+        }
+    }
+    
+    return static_cast<size_t>(bytes);
+}
+
+/**
+ * Validate a file path passed in from PHP: the same length and traversal limits as
+ * model identifiers, and it must be allowed by open_basedir
+ */
+static void checkUserPath(const std::string& path, const std::string& what)
+{
+    if (path.empty() || path.length() > 512 || path.find("..") != std::string::npos ||
+        path.find('\0') != std::string::npos) {
+        throw Php::Exception("Invalid " + what + " path");
+    }
+    if (php_check_open_basedir_ex(path.c_str(), 0) != 0) {
+        throw Php::Exception("The " + what + " path " + path + " is not within the allowed path(s) (open_basedir)");
+    }
+}
+
+/**
+ * Validate a LoRA adapter scale; negative scales subtract the adapter's delta
+ */
+static float parseAdapterScale(const Php::Value& value)
+{
+    double scale = static_cast<double>(value);
+    if (std::isnan(scale) || std::isinf(scale) || scale < -10.0 || scale > 10.0) {
+        throw Php::Exception("Adapter scale must be between -10.0 and 10.0");
+    }
+    return static_cast<float>(scale);
+}
+
+/**
+ * Builds PHP values straight from JsonStreamParser events, as json_decode($json, true) would
+ */
+class PhpJsonBuilder : public JsonHandler
+{
+public:
+    void startObject() override { open(true); }
+    void endObject() override { close(); }
+    void startArray() override { open(false); }
+    void endArray() override { close(); }
+    void key(std::string&& name) override { stack.back().key = std::move(name); }
+    void string(std::string&& value) override { add(Php::Value(value)); }
+    void boolean(bool value) override { add(Php::Value(value)); }
+    void null() override { add(Php::Value()); }
+    
+    void reset() override
+    {
+        stack.clear();
+        root = Php::Value();
+    }
+    
+    void number(const std::string& text) override
+    {
+        // Integers that overflow int64 become floats, like json_decode
+        if (text.find_first_of(".eE") == std::string::npos) {
+            try {
+                add(Php::Value(static_cast<int64_t>(std::stoll(text))));
+                return;
+            } catch (const std::out_of_range&) {
+            }
+        }
+        add(Php::Value(std::stod(text)));
+    }
+    
+    Php::Value result() const { return root; }
+
+private:
+    struct Frame {
+        Php::Value value = Php::Array();
+        bool object = false;
+        std::string key;    // Of the next member, in objects
+        int64_t index = 0;  // Of the next element, in arrays
+    };
+    std::vector<Frame> stack;
+    Php::Value root;
+    
+    void add(const Php::Value& value)
+    {
+        if (stack.empty()) {
+            root = value;
+            return;
+        }
+        
+        Frame& top = stack.back();
+        if (top.object) {
+            top.value[top.key] = value;
+        } else {
+            top.value[top.index++] = value;
+        }
+    }
+    
+    void open(bool object)
+    {
+        stack.emplace_back();
+        stack.back().object = object;
+    }
+    
+    void close()
+    {
+        Php::Value value = stack.back().value;
+        stack.pop_back();
+        add(value);
+    }
+};
 
 /**
  * Phllama PHP Extension
@@ -29,11 +197,22 @@ private:
     std::string model_path;
     std::string model_identifier;
     bool is_ollama_model;
+    HardwareConfig hardware_config;
     std::unique_ptr<LlamaInterface> llama_engine;
-    
+    std::future<void> pending_load; // Set while a loadAsync() load is in flight
+    std::string load_error;
+    double last_queue_ms = 0.0;     // Admission wait of the last call
+
 public:
     Phllama() = default;
-    virtual ~Phllama() = default;
+    
+    virtual ~Phllama()
+    {
+        // Abort an in-flight background load; the future's destructor waits for the thread
+        if (pending_load.valid() && llama_engine) {
+            llama_engine->cancelLoad();
+        }
+    }
     
     /**
      * Constructor - Initialize with model identifier
@@ -43,95 +222,342 @@ public:
      */
     void __construct(Php::Parameters &params)
     {
-        if (params.size() < 1 || params.size() > 2) {
-            throw Php::Exception("Phllama constructor requires 1-2 parameters: model identifier [, hardware_config]");
+        applyProcessSettings(); // May turn tracing on, so it must precede the span
+        TraceSpan span("Phllama::__construct");
+        prepare(params);
+        
+        try {
+            initializeModel();
+        } catch (const std::exception& e) {
+            throw Php::Exception("Failed to initialize model '" + model_identifier + "': " + e.what());
+        }
+    }
+    
+    /**
+     * Create a Phllama whose model loads on a background thread
+     * The object is returned immediately; isReady()/waitReady() report completion
+     * and any other method blocks until the load has finished
+     * 
+     * @param model_identifier Ollama model name or path to a GGUF file
+     * @param hardware_config  Optional hardware configuration overrides
+     * @return Phllama
+     */
+    static Php::Value loadAsync(Php::Parameters &params)
+    {
+        Phllama* phllama = new Phllama();
+        try {
+            phllama->prepare(params);
+            phllama->applyProcessSettings();
+        } catch (...) {
+            delete phllama;
+            throw;
         }
         
-        model_identifier = static_cast<std::string>(params[0]);
+        // PHP state is only touched above; the worker thread runs pure C++ loading code
+        phllama->llama_engine = std::make_unique<LlamaInterface>();
+        phllama->pending_load = std::async(std::launch::async, [phllama]() {
+            phllama->loadModelFiles();
+        });
         
-        // Security: Input validation and sanitization
-        if (model_identifier.empty()) {
-            throw Php::Exception("Model identifier cannot be empty");
+        return Php::Object("Phllama", phllama);
+    }
+    
+    /**
+     * Check whether the model has finished loading
+     * 
+     * @return True once the model is ready, false while it is still loading
+     * @throws Exception if the background load failed
+     */
+    Php::Value isReady()
+    {
+        if (pending_load.valid() &&
+            pending_load.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
         }
         
-        // Check for maximum length to prevent memory issues
-        if (model_identifier.length() > 512) {
-            throw Php::Exception("Model identifier too long (max 512 characters)");
+        waitForLoad();
+        return true;
+    }
+    
+    /**
+     * Block until the model has finished loading
+     * 
+     * @param timeout_ms Maximum time to wait in milliseconds (-1 = no limit)
+     * @return True if the model is ready, false if the timeout expired first
+     */
+    Php::Value waitReady(Php::Parameters &params)
+    {
+        int64_t timeout_ms = params.size() > 0 ? params[0].numericValue() : -1;
+        
+        if (timeout_ms >= 0 && pending_load.valid() &&
+            pending_load.wait_for(std::chrono::milliseconds(timeout_ms)) != std::future_status::ready) {
+            return false;
         }
         
-        // Security: Prevent directory traversal and command injection
-        if (model_identifier.find("../") != std::string::npos ||
-            model_identifier.find("..\\") != std::string::npos ||
-            model_identifier.find("\\") != std::string::npos ||
-            model_identifier.find(";") != std::string::npos ||
-            model_identifier.find("|") != std::string::npos ||
-            model_identifier.find("&") != std::string::npos ||
-            model_identifier.find("$") != std::string::npos ||
-            model_identifier.find("`") != std::string::npos) {
-            throw Php::Exception("Invalid characters in model identifier");
+        waitForLoad();
+        return true;
+    }
+    
+    /**
+     * Get the model loading progress, including page-cache prefetching
+     * 
+     * @return Float between 0.0 and 1.0
+     */
+    Php::Value getLoadProgress()
+    {
+        if (!llama_engine) {
+            return 0.0;
         }
         
-        // Security: Check for valid characters (alphanumeric, dash, underscore, dot, colon, slash for paths)
-        if (!std::regex_match(model_identifier, std::regex("^[a-zA-Z0-9._:/-]+$"))) {
-            throw Php::Exception("Model identifier contains invalid characters");
+        return static_cast<double>(llama_engine->getLoadProgress());
+    }
+    
+    /**
+     * Generate a response to the given message
+     * 
+     * @param message The input message/prompt
+     * @param options Optional per-call settings:
+     *                - max_tokens: maximum tokens to generate (1-4096, default 512)
+     *                - adapter:    LoRA adapter to use for this call only (null = base model)
+     *                - timeout_ms / deadline: stop with the partial response once exceeded
+     *                - priority, queue_timeout_ms: admission control settings
+     *                - n:          number of completions sampled from one prefill (1-16)
+     * @return Generated response string, or an array of n strings when n > 1
+     */
+    Php::Value sendMessage(Php::Parameters &params)
+    {
+        return processMessage(params, false);
+    }
+    
+    /**
+     * Generate a JSON response and return it decoded, as json_decode($response, true) would
+     * The output is parsed as it is generated: text before the first '{' or '[' is
+     * skipped and generation stops as soon as that object or array closes.
+     * 
+     * @param message The input message/prompt, asking for a JSON object or array
+     * @param options Same as sendMessage(), except n
+     * @return The decoded array
+     */
+    Php::Value sendMessageJson(Php::Parameters &params)
+    {
+        return processMessage(params, true);
+    }
+    
+    /**
+     * Reply to a conversation, formatted with the chat template embedded in the model
+     * The tokenized history and its KV cache are kept between calls, so each turn only
+     * processes the messages appended since the previous one. Pass the full history
+     * every time, including the assistant replies returned earlier.
+     * 
+     * @param messages List of ['role' => 'system'|'user'|'assistant', 'content' => string]
+     * @param options  Same as sendMessage(), except n; 'json' => true returns the reply
+     *                 decoded as by sendMessageJson()
+     * @return The assistant's reply
+     */
+    Php::Value chat(Php::Parameters &params)
+    {
+        bool json = params.size() > 1 && params[1].contains("json") && params[1].get("json").boolValue();
+        return processMessage(params, json, true);
+    }
+    
+    /**
+     * Score candidate continuations of a prompt without generating
+     * The prompt is processed once and all candidates are evaluated together in
+     * batched forward passes, e.g. to pick a label for classification or routing
+     * 
+     * @param prompt     The input prompt
+     * @param candidates Array of candidate continuations (max 256); tokenized on their
+     *                   own, so include a leading space where the model expects one
+     * @return Array (in candidate order) of ['candidate', 'logprob', 'avg_logprob', 'tokens']
+     */
+    Php::Value score(Php::Parameters &params)
+    {
+        if (params.size() != 2) {
+            throw Php::Exception("score requires exactly two parameters: prompt, candidates");
         }
         
-        // Determine if this is a file path or ollama model name
-        if (model_identifier.find('/') != std::string::npos || 
-            model_identifier.find(".gguf") != std::string::npos ||
-            model_identifier.find('\\') != std::string::npos) {
-            // File path
-            model_path = model_identifier;
-            is_ollama_model = false;
-        } else {
-            // Ollama model name
-            model_path = model_identifier;
-            is_ollama_model = true;
+        std::string prompt = static_cast<std::string>(params[0]);
+        
+        if (prompt.empty()) {
+            throw Php::Exception("Prompt cannot be empty");
+        }
+        
+        if (prompt.length() > 100000) {
+            throw Php::Exception("Prompt too long (max 100KB)");
+        }
+        
+        if (!params[1].isArray() || params[1].size() == 0 || params[1].size() > 256) {
+            throw Php::Exception("candidates must be an array of 1-256 strings");
+        }
+        
+        std::vector<std::string> candidates = params[1].vectorValue<std::string>();
+        for (const auto& candidate : candidates) {
+            if (candidate.empty() || candidate.length() > 10000) {
+                throw Php::Exception("Candidates must be non-empty strings of at most 10000 bytes");
+            }
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized");
         }
         
+        auto admission = admit(AdmissionPriority::NORMAL, -1, std::chrono::steady_clock::time_point::max());
+        
         try {
-            initializeModel();
+            auto scores = llama_engine->score(prompt, candidates);
+            
+            Php::Array result;
+            for (size_t i = 0; i < scores.size(); i++) {
+                Php::Array entry;
+                entry["candidate"] = candidates[i];
+                entry["logprob"] = scores[i].logprob;
+                entry["avg_logprob"] = scores[i].avg_logprob;
+                entry["tokens"] = scores[i].tokens;
+                result[i] = entry;
+            }
+            return result;
         } catch (const std::exception& e) {
-            throw Php::Exception("Failed to initialize model '" + model_identifier + "': " + e.what());
+            throw Php::Exception("Failed to score candidates: " + std::string(e.what()));
         }
     }
     
     /**
-     * Generate a response to the given message
+     * Record log-probabilities for generated tokens
+     * Each token's logprob and its k most likely alternatives are reported by
+     * getLastGenerationInfo() under 'logprobs'
      * 
-     * @param message The input message/prompt
-     * @return Generated response string
+     * @param k Number of alternatives per token (0-20, 0 disables)
      */
-    Php::Value sendMessage(Php::Parameters &params)
+    void setLogprobs(Php::Parameters &params)
     {
         if (params.size() != 1) {
-            throw Php::Exception("sendMessage requires exactly one parameter: message");
+            throw Php::Exception("setLogprobs requires exactly one parameter: k");
         }
         
-        std::string message = static_cast<std::string>(params[0]);
+        waitForLoad();
         
-        // Security: Input validation
-        if (message.empty()) {
-            throw Php::Exception("Message cannot be empty");
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set logprobs.");
         }
         
-        // Security: Prevent extremely large inputs that could cause memory issues
-        if (message.length() > 100000) {
-            throw Php::Exception("Message too long (max 100KB)");
+        int64_t k = params[0].numericValue();
+        
+        if (k < 0 || k > 20) {
+            throw Php::Exception("k must be between 0 and 20, got: " + std::to_string(k));
+        }
+        
+        llama_engine->setTopLogprobs(static_cast<int>(k));
+    }
+    
+    /**
+     * Load a LoRA adapter on top of the base model
+     * Adapters are cached per process with the base model, so loading the same
+     * file again (from any Phllama on the same model) is free
+     * 
+     * @param path  Path to a GGUF LoRA adapter
+     * @param scale Adapter strength, -10.0 to 10.0 (default 1.0)
+     * @param name  Name to refer to the adapter by (default: file name without extension)
+     * @return The adapter name
+     */
+    Php::Value loadAdapter(Php::Parameters &params)
+    {
+        if (params.size() < 1 || params.size() > 3) {
+            throw Php::Exception("loadAdapter requires 1-3 parameters: path [, scale [, name]]");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot load adapter.");
+        }
+        
+        std::string path = static_cast<std::string>(params[0]);
+        float scale = params.size() > 1 && !params[1].isNull() ? parseAdapterScale(params[1]) : 1.0f;
+        std::string name = params.size() > 2 && !params[2].isNull() ? static_cast<std::string>(params[2]) : "";
+        
+        checkUserPath(path, "adapter");
+        
+        if (path.length() < 5 || path.compare(path.length() - 5, 5, ".gguf") != 0) {
+            throw Php::Exception("Only GGUF adapters are supported. File: " + path);
+        }
+        
+        if (name.length() > 128) {
+            throw Php::Exception("Adapter name too long (max 128 characters)");
         }
         
         try {
-            return generateResponse(message);
+            return llama_engine->loadAdapter(path, scale, name);
         } catch (const std::exception& e) {
-            throw Php::Exception("Failed to generate response: " + std::string(e.what()));
+            throw Php::Exception("Failed to load adapter: " + std::string(e.what()));
+        }
+    }
+    
+    /**
+     * Select the adapter used by subsequent calls, without reloading any weights
+     * 
+     * @param name  A loaded adapter name, or null for the base model
+     * @param scale Scale overriding the one given to loadAdapter(), -10.0 to 10.0,
+     *              or null for the adapter's own scale
+     */
+    void useAdapter(Php::Parameters &params)
+    {
+        if (params.size() < 1 || params.size() > 2) {
+            throw Php::Exception("useAdapter requires 1-2 parameters: name [, scale]");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot use adapter.");
+        }
+        
+        std::string name = params[0].isNull() ? "" : static_cast<std::string>(params[0]);
+        std::optional<float> scale;
+        if (params.size() > 1 && !params[1].isNull()) {
+            scale = parseAdapterScale(params[1]);
+        }
+        
+        try {
+            llama_engine->useAdapter(name, scale);
+        } catch (const std::exception& e) {
+            throw Php::Exception("Failed to use adapter: " + std::string(e.what()));
         }
     }
     
     /**
-     * Set the sampling temperature (0.0 to 1.0)
-     * Higher values make output more random, lower values more deterministic
+     * List the adapters loaded on this model's base
      * 
-     * @param temperature Float between 0.0 and 1.0
+     * @return Array keyed by adapter name with path, scale and active flag
+     */
+    Php::Value getAdapters()
+    {
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized");
+        }
+        
+        Php::Array adapters;
+        std::string active = llama_engine->getActiveAdapter();
+        for (const auto& adapter : llama_engine->getAdapters()) {
+            Php::Array entry;
+            entry["path"] = adapter.path;
+            entry["scale"] = adapter.scale;
+            entry["active"] = adapter.name == active;
+            adapters[adapter.name] = entry;
+        }
+        
+        return adapters;
+    }
+    
+    /**
+     * Set the sampling temperature (0.0 to 2.0)
+     * Higher values make output more random, lower values more deterministic;
+     * 0.0 selects the most likely token every step (greedy decoding)
+     * 
+     * @param temperature Float between 0.0 and 2.0
      */
     void setTemperature(Php::Parameters &params)
     {
@@ -139,6 +565,8 @@ public:
             throw Php::Exception("setTemperature requires exactly one parameter: temperature");
         }
         
+        waitForLoad();
+        
         if (!llama_engine) {
             throw Php::Exception("Model not initialized. Cannot set temperature.");
         }
@@ -169,63 +597,621 @@ public:
             throw Php::Exception("setTopP requires exactly one parameter: top_p");
         }
         
+        waitForLoad();
+        
         if (!llama_engine) {
             throw Php::Exception("Model not initialized. Cannot set top_p.");
         }
         
-        double top_p = static_cast<double>(params[0]);
+        double top_p = static_cast<double>(params[0]);
+        
+        // Security: Validate numeric input
+        if (std::isnan(top_p) || std::isinf(top_p)) {
+            throw Php::Exception("Invalid top_p value");
+        }
+        
+        if (top_p < 0.0 || top_p > 1.0) {
+            throw Php::Exception("top_p must be between 0.0 and 1.0, got: " + std::to_string(top_p));
+        }
+        
+        llama_engine->setTopP(static_cast<float>(top_p));
+    }
+    
+    /**
+     * Set the top-k sampling parameter
+     * Restricts sampling to the k most likely tokens; 0 disables top-k
+     * 
+     * @param top_k Integer >= 0
+     */
+    void setTopK(Php::Parameters &params)
+    {
+        if (params.size() != 1) {
+            throw Php::Exception("setTopK requires exactly one parameter: top_k");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set top_k.");
+        }
+        
+        int64_t top_k = params[0].numericValue();
+        
+        if (top_k < 0 || top_k > 1000000) {
+            throw Php::Exception("top_k must be between 0 and 1000000, got: " + std::to_string(top_k));
+        }
+        
+        llama_engine->setTopK(static_cast<int>(top_k));
+    }
+    
+    /**
+     * Set the min-p sampling parameter (0.0 to 1.0)
+     * Drops tokens whose probability is below min_p times that of the most likely token
+     * 
+     * @param min_p Float between 0.0 and 1.0, 0.0 disables min-p
+     */
+    void setMinP(Php::Parameters &params)
+    {
+        if (params.size() != 1) {
+            throw Php::Exception("setMinP requires exactly one parameter: min_p");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set min_p.");
+        }
+        
+        double min_p = static_cast<double>(params[0]);
+        
+        if (std::isnan(min_p) || std::isinf(min_p)) {
+            throw Php::Exception("Invalid min_p value");
+        }
+        
+        if (min_p < 0.0 || min_p > 1.0) {
+            throw Php::Exception("min_p must be between 0.0 and 1.0, got: " + std::to_string(min_p));
+        }
+        
+        llama_engine->setMinP(static_cast<float>(min_p));
+    }
+    
+    /**
+     * Set the repetition penalty applied to recently generated tokens
+     * 
+     * @param penalty Float between 0.0 and 2.0, 1.0 disables the penalty
+     * @param last_n  Number of recent tokens to penalize (default 64, -1 = whole context)
+     */
+    void setRepeatPenalty(Php::Parameters &params)
+    {
+        if (params.size() < 1 || params.size() > 2) {
+            throw Php::Exception("setRepeatPenalty requires 1-2 parameters: penalty [, last_n]");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set repeat penalty.");
+        }
+        
+        double penalty = static_cast<double>(params[0]);
+        int64_t last_n = params.size() > 1 ? params[1].numericValue() : 64;
+        
+        if (std::isnan(penalty) || std::isinf(penalty)) {
+            throw Php::Exception("Invalid repeat penalty value");
+        }
+        
+        if (penalty < 0.0 || penalty > 2.0) {
+            throw Php::Exception("Repeat penalty must be between 0.0 and 2.0, got: " + std::to_string(penalty));
+        }
+        
+        if (last_n < -1 || last_n > 65536) {
+            throw Php::Exception("last_n must be between -1 and 65536, got: " + std::to_string(last_n));
+        }
+        
+        llama_engine->setRepeatPenalty(static_cast<float>(penalty), static_cast<int>(last_n));
+    }
+    
+    /**
+     * Set the frequency penalty (-2.0 to 2.0)
+     * Penalizes tokens proportionally to how often they already appeared
+     * 
+     * @param penalty Float between -2.0 and 2.0, 0.0 disables the penalty
+     */
+    void setFrequencyPenalty(Php::Parameters &params)
+    {
+        if (params.size() != 1) {
+            throw Php::Exception("setFrequencyPenalty requires exactly one parameter: penalty");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set frequency penalty.");
+        }
+        
+        double penalty = static_cast<double>(params[0]);
+        
+        if (std::isnan(penalty) || std::isinf(penalty)) {
+            throw Php::Exception("Invalid frequency penalty value");
+        }
+        
+        if (penalty < -2.0 || penalty > 2.0) {
+            throw Php::Exception("Frequency penalty must be between -2.0 and 2.0, got: " + std::to_string(penalty));
+        }
+        
+        llama_engine->setFrequencyPenalty(static_cast<float>(penalty));
+    }
+    
+    /**
+     * Set the presence penalty (-2.0 to 2.0)
+     * Penalizes every token that already appeared, regardless of count
+     * 
+     * @param penalty Float between -2.0 and 2.0, 0.0 disables the penalty
+     */
+    void setPresencePenalty(Php::Parameters &params)
+    {
+        if (params.size() != 1) {
+            throw Php::Exception("setPresencePenalty requires exactly one parameter: penalty");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set presence penalty.");
+        }
+        
+        double penalty = static_cast<double>(params[0]);
+        
+        if (std::isnan(penalty) || std::isinf(penalty)) {
+            throw Php::Exception("Invalid presence penalty value");
+        }
+        
+        if (penalty < -2.0 || penalty > 2.0) {
+            throw Php::Exception("Presence penalty must be between -2.0 and 2.0, got: " + std::to_string(penalty));
+        }
+        
+        llama_engine->setPresencePenalty(static_cast<float>(penalty));
+    }
+    
+    /**
+     * Set the random seed used for sampling
+     * A fixed seed makes repeated calls with the same prompt reproducible
+     * 
+     * @param seed Integer between 0 and 4294967294, or -1 for a random seed
+     */
+    void setSeed(Php::Parameters &params)
+    {
+        if (params.size() != 1) {
+            throw Php::Exception("setSeed requires exactly one parameter: seed");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set seed.");
+        }
+        
+        int64_t seed = params[0].numericValue();
+        
+        if (seed < -1 || seed >= 0xFFFFFFFFLL) {
+            throw Php::Exception("Seed must be between 0 and 4294967294 or -1, got: " + std::to_string(seed));
+        }
+        
+        llama_engine->setSeed(seed == -1 ? 0xFFFFFFFFu : static_cast<uint32_t>(seed));
+    }
+    
+    /**
+     * Enable sliding-window context shifting
+     * When the context window fills up, the oldest unpinned half of the history is
+     * discarded from the KV cache and the rest shifted down, so generation continues
+     * instead of stopping; oversized prompts are cut in the middle the same way
+     * 
+     * @param enabled True to enable context shifting
+     * @param keep    Number of leading prompt tokens (e.g. the system prompt) that are never discarded,
+     *                at most a quarter of the context window; a leading BOS token is always kept
+     */
+    void setContextShift(Php::Parameters &params)
+    {
+        if (params.size() < 1 || params.size() > 2) {
+            throw Php::Exception("setContextShift requires 1-2 parameters: enabled [, keep]");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set context shift.");
+        }
+        
+        int64_t keep = params.size() > 1 ? params[1].numericValue() : 0;
+        
+        if (keep < 0 || keep > 1048576) {
+            throw Php::Exception("keep must be between 0 and 1048576, got: " + std::to_string(keep));
+        }
+        
+        try {
+            llama_engine->setContextShift(params[0].boolValue(), static_cast<int>(keep));
+        } catch (const std::exception& e) {
+            throw Php::Exception(e.what());
+        }
+    }
+    
+    /**
+     * Enable prompt lookup decoding
+     * The tokens that followed the previous occurrence of the latest n-gram, in the prompt
+     * or the output so far, are verified in the same decode as the next token. Output is
+     * unchanged; copy-heavy tasks (extraction, rewriting, code edits) decode several
+     * tokens per step.
+     * 
+     * @param draft_tokens Tokens proposed per step (0 disables, typically 5-10)
+     * @param ngram        Longest n-gram to match (default 3)
+     */
+    void setPromptLookup(Php::Parameters &params)
+    {
+        if (params.size() < 1 || params.size() > 2) {
+            throw Php::Exception("setPromptLookup requires 1-2 parameters: draft_tokens [, ngram]");
+        }
+        
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot set prompt lookup.");
+        }
+        
+        int64_t draft_tokens = params[0].numericValue();
+        int64_t ngram = params.size() > 1 ? params[1].numericValue() : 3;
+        
+        if (draft_tokens < 0 || draft_tokens > 64) {
+            throw Php::Exception("draft_tokens must be between 0 and 64, got: " + std::to_string(draft_tokens));
+        }
+        
+        if (ngram < 1 || ngram > 16) {
+            throw Php::Exception("ngram must be between 1 and 16, got: " + std::to_string(ngram));
+        }
+        
+        llama_engine->setPromptLookup(static_cast<int>(draft_tokens), static_cast<int>(ngram));
+    }
+    
+    /**
+     * Get statistics about the most recent sendMessage() call
+     * 
+     * @return Array with token counts, context shifts, stop reason and timings
+     */
+    Php::Value getLastGenerationInfo()
+    {
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized");
+        }
+        
+        GenerationInfo last = llama_engine->getLastGenerationInfo();
+        
+        Php::Array info;
+        info["prompt_tokens"] = last.prompt_tokens;
+        info["prompt_tokens_truncated"] = last.prompt_tokens_truncated;
+        info["prompt_tokens_cached"] = last.prompt_tokens_cached;
+        info["generated_tokens"] = last.generated_tokens;
+        info["context_shifts"] = last.context_shifts;
+        info["draft_tokens"] = last.draft_tokens;
+        info["draft_accepted"] = last.draft_accepted;
+        info["draft_acceptance_rate"] = last.draft_tokens > 0 ?
+            static_cast<double>(last.draft_accepted) / last.draft_tokens : 0.0;
+        info["stop_reason"] = last.stop_reason;
+        info["prompt_ms"] = last.prompt_ms;
+        info["generation_ms"] = last.generation_ms;
+        info["tokens_per_second"] = last.generation_ms > 0.0 ?
+            last.generated_tokens * 1000.0 / last.generation_ms : 0.0;
+        info["queue_ms"] = last_queue_ms;
+        
+        if (!last.completion_stop_reasons.empty()) {
+            Php::Array reasons;
+            for (size_t i = 0; i < last.completion_stop_reasons.size(); i++) {
+                reasons[i] = last.completion_stop_reasons[i];
+            }
+            info["completion_stop_reasons"] = reasons;
+        }
+        
+        if (!last.logprobs.empty()) {
+            Php::Array logprobs;
+            for (size_t i = 0; i < last.logprobs.size(); i++) {
+                Php::Array entry;
+                entry["token"] = last.logprobs[i].token;
+                entry["logprob"] = last.logprobs[i].logprob;
+                Php::Array top;
+                for (size_t j = 0; j < last.logprobs[i].top.size(); j++) {
+                    Php::Array alternative;
+                    alternative["token"] = last.logprobs[i].top[j].first;
+                    alternative["logprob"] = last.logprobs[i].top[j].second;
+                    top[j] = alternative;
+                }
+                entry["top"] = top;
+                logprobs[i] = entry;
+            }
+            info["logprobs"] = logprobs;
+        }
+        
+        return info;
+    }
+    
+    /**
+     * Clear the KV cache to free memory
+     * Useful for long-running processes or when switching contexts
+     */
+    void clearCache()
+    {
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized. Cannot clear cache.");
+        }
+        
+        llama_engine->clearCache();
+    }
+    
+    /**
+     * Get information about the loaded model
+     * 
+     * @return Array with model information
+     */
+    Php::Value getModelInfo()
+    {
+        waitForLoad();
+        
+        if (!llama_engine) {
+            throw Php::Exception("Model not initialized");
+        }
+        
+        Php::Array info;
+        info["identifier"] = model_identifier;
+        info["path"] = model_path;
+        info["type"] = is_ollama_model ? "ollama" : "direct";
+        info["version"] = "1.0.0-alpha";
+        
+        // Header metadata is cached by mtime, so this is cheap on every call
+        try {
+            GGUFInfo gguf = GGUFReader::readInfo(model_path);
+            addModelMetadata(info, gguf);
+            info["chat_template"] = gguf.chat_template;
+        } catch (const std::exception& e) {
+            info["metadata_error"] = e.what();
+        }
+        
+        return info;
+    }
+
+
+private:
+    /**
+     * Validate the constructor arguments and resolve the hardware configuration
+     */
+    void prepare(Php::Parameters &params)
+    {
+        if (params.size() < 1 || params.size() > 2) {
+            throw Php::Exception("Phllama constructor requires 1-2 parameters: model identifier [, hardware_config]");
+        }
+        
+        model_identifier = static_cast<std::string>(params[0]);
+        
+        // Security: Input validation and sanitization
+        if (model_identifier.empty()) {
+            throw Php::Exception("Model identifier cannot be empty");
+        }
+        
+        // Check for maximum length to prevent memory issues
+        if (model_identifier.length() > 512) {
+            throw Php::Exception("Model identifier too long (max 512 characters)");
+        }
+        
+        // Security: Prevent directory traversal and command injection
+        if (model_identifier.find("../") != std::string::npos ||
+            model_identifier.find("..\\") != std::string::npos ||
+            model_identifier.find("\\") != std::string::npos ||
+            model_identifier.find(";") != std::string::npos ||
+            model_identifier.find("|") != std::string::npos ||
+            model_identifier.find("&") != std::string::npos ||
+            model_identifier.find("$") != std::string::npos ||
+            model_identifier.find("`") != std::string::npos) {
+            throw Php::Exception("Invalid characters in model identifier");
+        }
+        
+        // Security: Check for valid characters (alphanumeric, dash, underscore, dot, colon, slash for paths)
+        if (!std::regex_match(model_identifier, std::regex("^[a-zA-Z0-9._:/-]+$"))) {
+            throw Php::Exception("Model identifier contains invalid characters");
+        }
+        
+        try {
+            hardware_config = buildHardwareConfig(params.size() > 1 ? params[1] : Php::Value());
+        } catch (const std::exception& e) {
+            throw Php::Exception("Invalid hardware configuration: " + std::string(e.what()));
+        }
+        
+        // Determine if this is a file path or ollama model name
+        if (model_identifier.find('/') != std::string::npos || 
+            model_identifier.find(".gguf") != std::string::npos ||
+            model_identifier.find('\\') != std::string::npos) {
+            // File path
+            model_path = model_identifier;
+            is_ollama_model = false;
+        } else {
+            // Ollama model name
+            model_path = model_identifier;
+            is_ollama_model = true;
+        }
+    }
+    
+    /**
+     * Wait for a background load to finish and surface its failure
+     */
+    void waitForLoad()
+    {
+        if (pending_load.valid()) {
+            try {
+                pending_load.get();
+            } catch (const std::exception& e) {
+                load_error = "Failed to initialize model '" + model_identifier + "': " + e.what();
+            }
+        }
+        
+        if (!load_error.empty()) {
+            throw Php::Exception(load_error);
+        }
+    }
+    
+    /**
+     * Build the hardware configuration from phllama.* ini defaults,
+     * overridden by the optional array passed to the constructor
+     */
+    static HardwareConfig buildHardwareConfig(const Php::Value& overrides)
+    {
+        auto setting = [&overrides](const char* key) -> Php::Value {
+            if (overrides.isArray() && overrides.contains(key)) {
+                return overrides.get(key);
+            }
+            return static_cast<std::string>(Php::ini_get((std::string("phllama.") + key).c_str()));
+        };
+        
+        HardwareConfig config;
+        config.gpu_mode = static_cast<GPUMode>(setting("gpu_mode").numericValue());
+        config.gpu_layers = static_cast<int>(setting("gpu_layers").numericValue());
+        config.main_gpu = static_cast<int>(setting("main_gpu").numericValue());
+        config.cpu_threads = static_cast<int>(setting("cpu_threads").numericValue());
+        config.prefill_threads = static_cast<int>(setting("prefill_threads").numericValue());
+        config.decode_threads = static_cast<int>(setting("decode_threads").numericValue());
+        config.use_mmap = setting("use_mmap").boolValue();
+        config.use_mlock = setting("use_mlock").boolValue();
+        config.numa_node = static_cast<int>(setting("numa_node").numericValue());
+        config.prefetch_threads = static_cast<int>(std::clamp<int64_t>(setting("prefetch_threads").numericValue(), 0, 64));
+        config.context_size = static_cast<int>(setting("context_size").numericValue());
+        config.batch_size = static_cast<int>(setting("batch_size").numericValue());
+        
+        if (config.gpu_mode < GPUMode::AUTO || config.gpu_mode > GPUMode::DUAL_GPU) {
+            throw std::invalid_argument("gpu_mode must be -1, 0, 1 or 2");
+        }
+        
+        if (config.context_size < 128 || config.context_size > 1048576) {
+            throw std::invalid_argument("context_size must be between 128 and 1048576");
+        }
+        
+        if (config.batch_size < 1 || config.batch_size > config.context_size) {
+            throw std::invalid_argument("batch_size must be between 1 and context_size");
+        }
+        
+        for (int threads : {config.cpu_threads, config.prefill_threads, config.decode_threads}) {
+            if (threads == 0 || threads < -1 || threads > 1024) {
+                throw std::invalid_argument("thread counts must be -1 (auto) or between 1 and 1024");
+            }
+        }
+        
+        // NUMA strategy by name or by its numeric value
+        static const std::vector<std::string> strategies = {"disabled", "distribute", "isolate", "numactl", "mirror"};
+        std::string strategy = setting("numa").stringValue();
+        std::transform(strategy.begin(), strategy.end(), strategy.begin(), ::tolower);
+        if (strategy.empty()) {
+            strategy = "disabled";
+        } else if (std::all_of(strategy.begin(), strategy.end(), ::isdigit) &&
+                   std::stoul(strategy) < strategies.size()) {
+            strategy = strategies[std::stoul(strategy)];
+        }
+        auto found = std::find(strategies.begin(), strategies.end(), strategy);
+        if (found == strategies.end()) {
+            throw std::invalid_argument("numa must be one of disabled, distribute, isolate, numactl");
+        }
+        config.numa = static_cast<NumaStrategy>(found - strategies.begin());
+        if (config.numa == NumaStrategy::MIRROR) {
+            throw std::invalid_argument("numa strategy mirror is not implemented by ggml");
+        }
         
-        // Security: Validate numeric input
-        if (std::isnan(top_p) || std::isinf(top_p)) {
-            throw Php::Exception("Invalid top_p value");
+        if (config.numa_node >= LlamaInterface::detectNumaNodeCount()) {
+            throw std::invalid_argument("numa_node " + std::to_string(config.numa_node) + " does not exist");
         }
         
-        if (top_p < 0.0 || top_p > 1.0) {
-            throw Php::Exception("top_p must be between 0.0 and 1.0, got: " + std::to_string(top_p));
+        // CPU affinity may be given as a "0-15,32-47" list or an array of CPU ids
+        Php::Value affinity = setting("cpu_affinity");
+        if (affinity.isArray()) {
+            for (const auto& cpus : affinity.vectorValue<std::string>()) {
+                auto parsed = LlamaInterface::parseCPUList(cpus);
+                config.cpu_affinity.insert(config.cpu_affinity.end(), parsed.begin(), parsed.end());
+            }
+        } else {
+            config.cpu_affinity = LlamaInterface::parseCPUList(affinity.stringValue());
         }
         
-        llama_engine->setTopP(static_cast<float>(top_p));
+        return config;
     }
     
     /**
-     * Clear the KV cache to free memory
-     * Useful for long-running processes or when switching contexts
+     * Initialize the model based on whether it's an ollama model or direct file
      */
-    void clearCache()
+    void initializeModel()
     {
-        if (!llama_engine) {
-            throw Php::Exception("Model not initialized. Cannot clear cache.");
-        }
-        
-        llama_engine->clearCache();
+        llama_engine = std::make_unique<LlamaInterface>();
+        llama_engine->setAutoClearCache(static_cast<uint64_t>(
+            std::max<int64_t>(0, Php::ini_get("phllama.auto_clear_cache").numericValue())));
+        loadModelFiles();
     }
     
     /**
-     * Get information about the loaded model
-     * 
-     * @return Array with model information
+     * Apply process-wide phllama.* ini settings; must run on the PHP thread
      */
-    Php::Value getModelInfo()
+    void applyProcessSettings()
     {
-        if (!llama_engine) {
-            throw Php::Exception("Model not initialized");
+        // The budget may differ per directory/vhost, so pick it up on every load
+        size_t cache_budget = parseByteSize(static_cast<std::string>(Php::ini_get("phllama.model_cache_bytes")));
+        ModelCache::setBudget(cache_budget);
+        
+        // Pooled contexts are bound to a resident model, so without the model cache the pool
+        // (and its sweeper thread) stays off
+        ContextPool::Config pool;
+        pool.max_idle = cache_budget == 0 ? 0 :
+            static_cast<size_t>(std::max<int64_t>(0, Php::ini_get("phllama.context_pool_size").numericValue()));
+        pool.idle_timeout_ms = std::max<int64_t>(0, Php::ini_get("phllama.context_idle_timeout_ms").numericValue());
+        pool.reset = static_cast<std::string>(Php::ini_get("phllama.context_reset")) == "preserve" ?
+            ContextPool::ResetPolicy::PRESERVE : ContextPool::ResetPolicy::CLEAR;
+        ContextPool::configure(pool);
+        
+        std::string policy = static_cast<std::string>(Php::ini_get("phllama.thread_pool_policy"));
+        LlamaInterface::setThreadPoolConfig(
+            static_cast<int>(std::max<int64_t>(-1, static_cast<int64_t>(Php::ini_get("phllama.thread_pool_size")))),
+            policy == "serialize" ? ThreadPoolPolicy::SERIALIZE : ThreadPoolPolicy::INTERLEAVE);
+        
+        // phllama.trace turns tracing on from configuration; phllama_trace_enable() works at any time
+        if (Php::ini_get("phllama.trace").boolValue() && !Trace::isEnabled()) {
+            Trace::enable(static_cast<size_t>(std::max<int64_t>(1024, Php::ini_get("phllama.trace_buffer").numericValue())));
         }
+    }
+    
+    /**
+     * Wait for a host-wide inference slot; a no-op unless phllama.max_concurrent is set
+     * The wait ends at the call's deadline or after queue_timeout_ms (-1 = ini default)
+     */
+    std::unique_ptr<AdmissionControl::Slot> admit(AdmissionPriority priority, int64_t queue_timeout_ms,
+                                                  std::chrono::steady_clock::time_point deadline)
+    {
+        AdmissionControl::Config config;
+        config.max_concurrent = static_cast<int>(std::max<int64_t>(0, Php::ini_get("phllama.max_concurrent").numericValue()));
+        config.queue_limit = static_cast<int>(std::max<int64_t>(0, Php::ini_get("phllama.admission_queue_limit").numericValue()));
+        config.fast_fail = Php::ini_get("phllama.admission_fast_fail").boolValue();
+        AdmissionControl::configure(config);
         
-        Php::Array info;
-        info["identifier"] = model_identifier;
-        info["path"] = model_path;
-        info["type"] = is_ollama_model ? "ollama" : "direct";
-        info["version"] = "1.0.0-alpha";
+        if (queue_timeout_ms < 0) {
+            queue_timeout_ms = std::clamp<int64_t>(Php::ini_get("phllama.admission_timeout_ms").numericValue(),
+                                                   0, 24LL * 60 * 60 * 1000);
+        }
+        auto queue_deadline = std::min(deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(queue_timeout_ms));
         
-        return info;
+        try {
+            auto slot = std::make_unique<AdmissionControl::Slot>(priority, queue_deadline);
+            last_queue_ms = slot->getWaitMs();
+            return slot;
+        } catch (const std::exception& e) {
+            throw Php::Exception("Inference not admitted: " + std::string(e.what()));
+        }
     }
     
-
-private:
     /**
-     * Initialize the model based on whether it's an ollama model or direct file
+     * Resolve and load the model files; touches no PHP state so it can run on a worker thread
      */
-    void initializeModel()
+    void loadModelFiles()
     {
         if (is_ollama_model) {
             setupOllamaModel();
@@ -243,8 +1229,7 @@ private:
             std::string actual_path = OllamaInterface::downloadModel(model_path);
             model_path = actual_path;  // Update to actual file path
             
-            llama_engine = std::make_unique<LlamaInterface>();
-            if (!llama_engine->loadModel(actual_path)) {
+            if (!llama_engine->loadModel(actual_path, hardware_config)) {
                 throw std::runtime_error("Failed to load ollama model: " + model_identifier);
             }
         } catch (const std::exception& e) {
@@ -267,22 +1252,270 @@ private:
             throw std::runtime_error("Only GGUF files are supported. File: " + model_path);
         }
         
-        llama_engine = std::make_unique<LlamaInterface>();
-        if (!llama_engine->loadModel(model_path)) {
+        if (!llama_engine->loadModel(model_path, hardware_config)) {
             throw std::runtime_error("Failed to load model from path: " + model_path);
         }
     }
     
     /**
-     * Generate response using the loaded model
+     * Shared implementation of sendMessage() and sendMessageJson()
+     */
+    Php::Value processMessage(Php::Parameters &params, bool json, bool chat = false)
+    {
+        const std::string method = chat ? "chat" : json ? "sendMessageJson" : "sendMessage";
+        if (params.size() < 1 || params.size() > 2) {
+            throw Php::Exception(method + (chat ? " requires 1-2 parameters: messages [, options]" :
+                                                  " requires 1-2 parameters: message [, options]"));
+        }
+        
+        std::string message;
+        std::vector<ChatMessage> messages;
+        if (chat) {
+            messages = parseMessages(params[0]);
+        } else {
+            message = static_cast<std::string>(params[0]);
+            
+            // Security: Input validation
+            if (message.empty()) {
+                throw Php::Exception("Message cannot be empty");
+            }
+            
+            // Security: Prevent extremely large inputs that could cause memory issues
+            if (message.length() > 100000) {
+                throw Php::Exception("Message too long (max 100KB)");
+            }
+        }
+        
+        Php::Value options = params.size() > 1 ? params[1] : Php::Value();
+        
+        int64_t max_tokens = 512;
+        if (options.contains("max_tokens")) {
+            max_tokens = options.get("max_tokens").numericValue();
+            if (max_tokens < 1 || max_tokens > 4096) {
+                throw Php::Exception("max_tokens must be between 1 and 4096, got: " + std::to_string(max_tokens));
+            }
+        }
+        
+        int64_t n = 1;
+        if (options.contains("n")) {
+            n = options.get("n").numericValue();
+            if (n < 1 || n > 16) {
+                throw Php::Exception("n must be between 1 and 16, got: " + std::to_string(n));
+            }
+            if (n != 1 && (json || chat)) {
+                throw Php::Exception("n is not supported by " + method);
+            }
+        }
+        
+        // Per-call budget: timeout_ms from now and/or an absolute deadline in unix seconds
+        // (as returned by microtime(true)); the earlier of the two applies
+        // Budgets are capped at a day so the time point arithmetic cannot overflow
+        const int64_t max_budget_ms = 24LL * 60 * 60 * 1000;
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        if (options.contains("timeout_ms")) {
+            int64_t timeout_ms = options.get("timeout_ms").numericValue();
+            if (timeout_ms < 1 || timeout_ms > max_budget_ms) {
+                throw Php::Exception("timeout_ms must be between 1 and " + std::to_string(max_budget_ms) +
+                                     ", got: " + std::to_string(timeout_ms));
+            }
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        }
+        if (options.contains("deadline")) {
+            double deadline_unix = options.get("deadline").floatValue();
+            if (!std::isfinite(deadline_unix) || deadline_unix <= 0.0) {
+                throw Php::Exception("deadline must be a unix timestamp");
+            }
+            double now_unix = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+            double remaining_ms = std::max(0.0, (deadline_unix - now_unix) * 1000.0);
+            if (remaining_ms > static_cast<double>(max_budget_ms)) {
+                throw Php::Exception("deadline cannot be more than 24 hours in the future");
+            }
+            deadline = std::min(deadline, std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(static_cast<int64_t>(remaining_ms)));
+        }
+        
+        AdmissionPriority priority = AdmissionPriority::NORMAL;
+        if (options.contains("priority")) {
+            try {
+                priority = AdmissionControl::parsePriority(options.get("priority").stringValue());
+            } catch (const std::exception& e) {
+                throw Php::Exception(e.what());
+            }
+        }
+        
+        int64_t queue_timeout_ms = -1;
+        if (options.contains("queue_timeout_ms")) {
+            queue_timeout_ms = options.get("queue_timeout_ms").numericValue();
+            if (queue_timeout_ms < 0 || queue_timeout_ms > max_budget_ms) {
+                throw Php::Exception("queue_timeout_ms must be between 0 and " + std::to_string(max_budget_ms) +
+                                     ", got: " + std::to_string(queue_timeout_ms));
+            }
+        }
+        
+        // Preserved KV cells are shared between objects only when they pass the same cache_key
+        std::string cache_key;
+        if (options.contains("cache_key")) {
+            cache_key = options.get("cache_key").stringValue();
+            if (cache_key.empty() || cache_key.length() > 256) {
+                throw Php::Exception("cache_key must be a non-empty string of at most 256 bytes");
+            }
+        }
+        
+        waitForLoad();
+        
+        auto admission = admit(priority, queue_timeout_ms, deadline);
+        
+        // A per-call adapter is swapped in for this generation only
+        bool swap_adapter = options.contains("adapter");
+        std::string previous_adapter = llama_engine ? llama_engine->getActiveAdapter() : "";
+        float previous_scale = llama_engine ? llama_engine->getActiveAdapterScale() : 1.0f;
+        std::string previous_scope = llama_engine ? llama_engine->getCacheScope() : "";
+        if (llama_engine && !cache_key.empty()) {
+            llama_engine->setCacheScope("key:" + cache_key);
+        }
+        
+        try {
+            if (swap_adapter) {
+                Php::Value adapter = options.get("adapter");
+                llama_engine->useAdapter(adapter.isNull() ? "" : adapter.stringValue());
+            }
+            
+            Php::Value response = generateResponse(message, messages, static_cast<int>(max_tokens), static_cast<int>(n),
+                                                   deadline, json);
+            
+            if (swap_adapter) {
+                llama_engine->useAdapter(previous_adapter, previous_scale);
+            }
+            if (llama_engine) {
+                llama_engine->setCacheScope(previous_scope);
+            }
+            return response;
+        } catch (const std::exception& e) {
+            if (llama_engine) {
+                llama_engine->setCacheScope(previous_scope);
+            }
+            if (swap_adapter) {
+                try {
+                    llama_engine->useAdapter(previous_adapter, previous_scale);
+                } catch (const std::exception&) {
+                    // Keep the original error
+                }
+            }
+            throw Php::Exception("Failed to generate response: " + std::string(e.what()));
+        }
+    }
+    
+    /**
+     * Validate chat() messages: a list of ['role' => string, 'content' => string]
+     */
+    std::vector<ChatMessage> parseMessages(const Php::Value& value)
+    {
+        if (!value.isArray() || value.size() == 0 || value.size() > 1000) {
+            throw Php::Exception("messages must be an array of 1-1000 ['role' => ..., 'content' => ...] entries");
+        }
+        
+        std::vector<ChatMessage> messages;
+        size_t total_length = 0;
+        for (const auto& entry : value) {
+            const Php::Value& turn = entry.second;
+            if (!turn.isArray() || !turn.contains("role") || !turn.contains("content")) {
+                throw Php::Exception("Each message must be an array with 'role' and 'content'");
+            }
+            
+            ChatMessage message;
+            message.role = turn.get("role").stringValue();
+            message.content = turn.get("content").stringValue();
+            if (message.role.empty() || message.role.length() > 64) {
+                throw Php::Exception("Message role must be a non-empty string of at most 64 bytes");
+            }
+            total_length += message.content.length();
+            messages.push_back(std::move(message));
+        }
+        
+        // Security: Prevent extremely large inputs that could cause memory issues
+        if (total_length > 1000000) {
+            throw Php::Exception("Messages too long (max 1MB in total)");
+        }
+        
+        return messages;
+    }
+    
+    /**
+     * Generate while feeding each token to an incremental JSON parser, stopping at the
+     * end of the top-level value; the PHP value is built from the parse events directly
+     */
+    Php::Value generateJson(const std::string& message, const std::vector<ChatMessage>& messages, int max_tokens)
+    {
+        PhpJsonBuilder builder;
+        JsonStreamParser parser(builder);
+        auto on_piece = [&parser](const std::string& piece) {
+            parser.feed(piece);
+            return !parser.done();
+        };
+        if (messages.empty()) {
+            llama_engine->generate(message, max_tokens, on_piece);
+        } else {
+            llama_engine->chat(messages, max_tokens, on_piece);
+        }
+        
+        if (!parser.done()) {
+            std::string reason = llama_engine->getLastGenerationInfo().stop_reason;
+            std::string problem = parser.started() ? "Model output ended inside the JSON value" :
+                                  !parser.error().empty() ? "Model output is not valid JSON: " + parser.error() :
+                                  "Model output contains no JSON object or array";
+            throw std::runtime_error(problem + " (stop reason: " + reason + ")");
+        }
+        return builder.result();
+    }
+    
+    /**
+     * Generate response using the loaded model, from a prompt or (when given) chat messages
      */
-    std::string generateResponse(const std::string& message)
+    Php::Value generateResponse(const std::string& message, const std::vector<ChatMessage>& messages, int max_tokens, int n = 1,
+                                std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+                                bool json = false)
     {
         if (!llama_engine) {
             throw std::runtime_error("Model not initialized");
         }
         
-        return llama_engine->generate(message);
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            llama_engine->setDeadline(deadline);
+        }
+        
+        // Stop decoding for a client that has gone away. The flag is read straight from PHP's
+        // globals: calling connection_aborted() here could raise a timeout fatal mid-decode and
+        // unwind past the admission slot and thread pool lock held on this stack
+        if (Php::ini_get("phllama.abort_on_disconnect").boolValue()) {
+            llama_engine->setStopCheck([]() {
+                return (PG(connection_status) & PHP_CONNECTION_ABORTED) != 0;
+            });
+        }
+        
+        try {
+            Php::Value response;
+            if (n > 1) {
+                auto completions = llama_engine->generateN(message, n, max_tokens);
+                Php::Array list;
+                for (size_t i = 0; i < completions.size(); i++) {
+                    list[i] = completions[i];
+                }
+                response = list;
+            } else if (json) {
+                response = generateJson(message, messages, max_tokens);
+            } else if (!messages.empty()) {
+                response = llama_engine->chat(messages, max_tokens);
+            } else {
+                response = llama_engine->generate(message, max_tokens);
+            }
+            llama_engine->clearDeadline();
+            llama_engine->setStopCheck(nullptr);
+            return response;
+        } catch (...) {
+            llama_engine->clearDeadline();
+            llama_engine->setStopCheck(nullptr);
+            throw;
+        }
     }
 };
 
@@ -324,6 +1557,19 @@ Php::Value phllama_get_hardware_info() {
     info["gpu_count"] = gpu_count;
     info["cpu_threads"] = LlamaInterface::getOptimalCPUThreads();
     
+    int numa_nodes = LlamaInterface::detectNumaNodeCount();
+    info["numa_nodes"] = numa_nodes;
+    Php::Array numa_cpus;
+    for (int node = 0; node < numa_nodes; node++) {
+        Php::Array cpus;
+        auto node_cpus = LlamaInterface::getNumaNodeCPUs(node);
+        for (size_t i = 0; i < node_cpus.size(); i++) {
+            cpus[i] = node_cpus[i];
+        }
+        numa_cpus[node] = cpus;
+    }
+    info["numa_cpus"] = numa_cpus;
+    
     auto gpu_info = LlamaInterface::getGPUInfo();
     Php::Array gpu_details;
     for (size_t i = 0; i < gpu_info.size(); i++) {
@@ -339,9 +1585,226 @@ Php::Value phllama_get_hardware_info() {
     optimal_config["cpu_threads"] = optimal.cpu_threads;
     info["optimal_config"] = optimal_config;
     
+    Php::Array thread_pool;
+    thread_pool["size"] = LlamaInterface::getThreadPoolSize();
+    thread_pool["policy"] = LlamaInterface::getThreadPoolPolicy() == ThreadPoolPolicy::SERIALIZE ? "serialize" : "interleave";
+    info["thread_pool"] = thread_pool;
+    
+    return info;
+}
+
+Php::Value phllama_list_models() {
+    Php::Array models;
+    
+    std::vector<ModelEntry> entries;
+    try {
+        entries = OllamaInterface::listModels();
+    } catch (const std::exception& e) {
+        throw Php::Exception("Failed to list models: " + std::string(e.what()));
+    }
+    
+    int64_t index = 0;
+    for (const auto& entry : entries) {
+        Php::Array model;
+        model["name"] = entry.name;
+        model["path"] = entry.path;
+        model["source"] = entry.source;
+        
+        // Unreadable or foreign files still appear, without metadata
+        try {
+            GGUFInfo gguf = GGUFReader::readInfo(entry.path);
+            addModelMetadata(model, gguf);
+            model["has_chat_template"] = !gguf.chat_template.empty();
+        } catch (const std::exception& e) {
+            model["error"] = e.what();
+        }
+        
+        models[index++] = model;
+    }
+    
+    return models;
+}
+
+/**
+ * Quantize a GGUF model with the vendored llama.cpp
+ * Options: threads, imatrix (path), allow_requantize, pure
+ */
+Php::Value phllama_quantize(Php::Parameters &params) {
+    if (params.size() < 3 || params.size() > 4) {
+        throw Php::Exception("phllama_quantize requires 3-4 parameters: input, output, type [, options]");
+    }
+    
+    std::string input = static_cast<std::string>(params[0]);
+    std::string output = static_cast<std::string>(params[1]);
+    std::string type = static_cast<std::string>(params[2]);
+    Php::Value options = params.size() > 3 ? params[3] : Php::Value();
+    
+    checkUserPath(input, "input");
+    checkUserPath(output, "output");
+    
+    QuantizeOptions quantize_options;
+    if (options.contains("threads")) {
+        int64_t threads = options.get("threads").numericValue();
+        if (threads < 1 || threads > 1024) {
+            throw Php::Exception("threads must be between 1 and 1024, got: " + std::to_string(threads));
+        }
+        quantize_options.threads = static_cast<int>(threads);
+    }
+    if (options.contains("imatrix")) {
+        quantize_options.imatrix_path = options.get("imatrix").stringValue();
+        checkUserPath(quantize_options.imatrix_path, "imatrix");
+    }
+    if (options.contains("allow_requantize")) {
+        quantize_options.allow_requantize = options.get("allow_requantize").boolValue();
+    }
+    if (options.contains("pure")) {
+        quantize_options.pure = options.get("pure").boolValue();
+    }
+    
+    // No PHP code may run inside llama_model_quantize: a fatal error or timeout there would
+    // unwind past the quantize lock and the log capture, leaving both broken for the worker
+    if (options.contains("progress")) {
+        throw Php::Exception("The progress option is not supported; use the phllama-quantize tool to follow progress");
+    }
+    
+    QuantizeResult result;
+    try {
+        result = Quantizer::quantize(input, output, type, quantize_options);
+    } catch (const std::exception& e) {
+        throw Php::Exception("Failed to quantize model: " + std::string(e.what()));
+    }
+    
+    Php::Array info;
+    info["type"] = result.type;
+    info["input_bytes"] = static_cast<int64_t>(result.input_bytes);
+    info["output_bytes"] = static_cast<int64_t>(result.output_bytes);
+    info["seconds"] = result.seconds;
+    return info;
+}
+
+Php::Value phllama_admission_stats() {
+    AdmissionControl::Stats stats;
+    try {
+        stats = AdmissionControl::getStats();
+    } catch (const std::exception& e) {
+        throw Php::Exception("Failed to read admission stats: " + std::string(e.what()));
+    }
+    
+    Php::Array info;
+    info["max_concurrent"] = stats.max_concurrent;
+    info["running"] = stats.running;
+    info["waiting"] = stats.waiting;
+    Php::Array waiting;
+    waiting["high"] = stats.waiting_by_priority[static_cast<int>(AdmissionPriority::HIGH)];
+    waiting["normal"] = stats.waiting_by_priority[static_cast<int>(AdmissionPriority::NORMAL)];
+    waiting["low"] = stats.waiting_by_priority[static_cast<int>(AdmissionPriority::LOW)];
+    info["waiting_by_priority"] = waiting;
+    info["admitted"] = static_cast<int64_t>(stats.admitted);
+    info["rejected"] = static_cast<int64_t>(stats.rejected);
+    info["timed_out"] = static_cast<int64_t>(stats.timed_out);
+    info["avg_wait_ms"] = stats.avg_wait_ms;
+    info["max_wait_ms"] = stats.max_wait_ms;
+    return info;
+}
+
+/**
+ * Start recording trace events into a ring buffer of `capacity` events (default 65536)
+ */
+void phllama_trace_enable(Php::Parameters &params) {
+    int64_t capacity = params.size() > 0 ? params[0].numericValue() : 65536;
+    if (capacity < 1024 || capacity > 16777216) {
+        throw Php::Exception("capacity must be between 1024 and 16777216 events, got: " + std::to_string(capacity));
+    }
+    Trace::enable(static_cast<size_t>(capacity));
+}
+
+void phllama_trace_disable() {
+    Trace::disable();
+}
+
+void phllama_trace_clear() {
+    Trace::clear();
+}
+
+/**
+ * Chrome trace JSON of the buffered events; written to `path` when given (returns bytes written)
+ */
+Php::Value phllama_trace_dump(Php::Parameters &params) {
+    std::string json = Trace::dumpJson();
+    if (params.size() == 0 || params[0].isNull()) {
+        return json;
+    }
+    
+    std::string path = params[0].stringValue();
+    checkUserPath(path, "trace output");
+    
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw Php::Exception("Failed to open trace output " + path);
+    }
+    if (!out.write(json.data(), json.size())) {
+        throw Php::Exception("Failed to write trace to " + path);
+    }
+    return static_cast<int64_t>(json.size());
+}
+
+Php::Value phllama_model_cache_info() {
+    Php::Array info;
+    info["budget_bytes"] = static_cast<int64_t>(ModelCache::getBudget());
+    info["resident_bytes"] = static_cast<int64_t>(ModelCache::getResidentBytes());
+    
+    Php::Array models;
+    auto entries = ModelCache::getEntries();
+    for (size_t i = 0; i < entries.size(); i++) {
+        Php::Array model;
+        model["path"] = entries[i].path;
+        model["bytes"] = static_cast<int64_t>(entries[i].bytes);
+        model["in_use"] = entries[i].users > 0;
+        model["users"] = static_cast<int64_t>(entries[i].users);
+        model["hits"] = static_cast<int64_t>(entries[i].hits);
+        model["idle_seconds"] = entries[i].idle_seconds;
+        models[i] = model;
+    }
+    info["models"] = models;
+    
+    return info;
+}
+
+Php::Value phllama_model_cache_clear() {
+    return static_cast<int64_t>(ModelCache::evictIdle());
+}
+
+Php::Value phllama_context_pool_info() {
+    auto config = ContextPool::getConfig();
+    auto stats = ContextPool::getStats();
+    
+    Php::Array info;
+    info["max_idle"] = static_cast<int64_t>(config.max_idle);
+    info["idle_timeout_ms"] = config.idle_timeout_ms;
+    info["reset"] = config.reset == ContextPool::ResetPolicy::PRESERVE ? "preserve" : "clear";
+    info["idle"] = static_cast<int64_t>(stats.idle);
+    info["created"] = static_cast<int64_t>(stats.created);
+    info["reused"] = static_cast<int64_t>(stats.reused);
+    info["released"] = static_cast<int64_t>(stats.released);
+    
+    Php::Array contexts;
+    auto entries = ContextPool::getEntries();
+    for (size_t i = 0; i < entries.size(); i++) {
+        Php::Array context;
+        context["params"] = entries[i].key;
+        context["generations"] = static_cast<int64_t>(entries[i].generations);
+        context["idle_seconds"] = entries[i].idle_seconds;
+        contexts[i] = context;
+    }
+    info["contexts"] = contexts;
+    
     return info;
 }
 
+Php::Value phllama_context_pool_clear() {
+    return static_cast<int64_t>(ContextPool::releaseIdle());
+}
+
 extern "C" {
     /**
      * PHP Extension Module Entry Point
@@ -356,13 +1819,61 @@ extern "C" {
         
         // Core functionality
         phllama.method<&Phllama::__construct>("__construct", {
-            Php::ByVal("model", Php::Type::String)
+            Php::ByVal("model", Php::Type::String),
+            Php::ByVal("hardware_config", Php::Type::Array, false)
         });
         
+        phllama.method<&Phllama::loadAsync>("loadAsync", {
+            Php::ByVal("model", Php::Type::String),
+            Php::ByVal("hardware_config", Php::Type::Array, false)
+        });
+        
+        phllama.method<&Phllama::isReady>("isReady");
+        
+        phllama.method<&Phllama::waitReady>("waitReady", {
+            Php::ByVal("timeout_ms", Php::Type::Numeric, false)
+        });
+        
+        phllama.method<&Phllama::getLoadProgress>("getLoadProgress");
+        
         phllama.method<&Phllama::sendMessage>("sendMessage", {
-            Php::ByVal("message", Php::Type::String)
+            Php::ByVal("message", Php::Type::String),
+            Php::ByVal("options", Php::Type::Array, false)
+        });
+        
+        phllama.method<&Phllama::sendMessageJson>("sendMessageJson", {
+            Php::ByVal("message", Php::Type::String),
+            Php::ByVal("options", Php::Type::Array, false)
         });
         
+        phllama.method<&Phllama::chat>("chat", {
+            Php::ByVal("messages", Php::Type::Array),
+            Php::ByVal("options", Php::Type::Array, false)
+        });
+        
+        phllama.method<&Phllama::score>("score", {
+            Php::ByVal("prompt", Php::Type::String),
+            Php::ByVal("candidates", Php::Type::Array)
+        });
+        
+        phllama.method<&Phllama::setLogprobs>("setLogprobs", {
+            Php::ByVal("k", Php::Type::Numeric)
+        });
+        
+        // LoRA adapters
+        phllama.method<&Phllama::loadAdapter>("loadAdapter", {
+            Php::ByVal("path", Php::Type::String),
+            Php::ByVal("scale", Php::Type::Null, false),  // float or null
+            Php::ByVal("name", Php::Type::String, false)
+        });
+        
+        phllama.method<&Phllama::useAdapter>("useAdapter", {
+            Php::ByVal("name", Php::Type::Null),  // string or null
+            Php::ByVal("scale", Php::Type::Null, false)  // float or null
+        });
+        
+        phllama.method<&Phllama::getAdapters>("getAdapters");
+        
         // Configuration methods
         phllama.method<&Phllama::setTemperature>("setTemperature", {
             Php::ByVal("temperature", Php::Type::Float)
@@ -372,18 +1883,107 @@ extern "C" {
             Php::ByVal("top_p", Php::Type::Float)
         });
         
+        phllama.method<&Phllama::setTopK>("setTopK", {
+            Php::ByVal("top_k", Php::Type::Numeric)
+        });
+        
+        phllama.method<&Phllama::setMinP>("setMinP", {
+            Php::ByVal("min_p", Php::Type::Float)
+        });
+        
+        phllama.method<&Phllama::setRepeatPenalty>("setRepeatPenalty", {
+            Php::ByVal("penalty", Php::Type::Float),
+            Php::ByVal("last_n", Php::Type::Numeric, false)
+        });
+        
+        phllama.method<&Phllama::setFrequencyPenalty>("setFrequencyPenalty", {
+            Php::ByVal("penalty", Php::Type::Float)
+        });
+        
+        phllama.method<&Phllama::setPresencePenalty>("setPresencePenalty", {
+            Php::ByVal("penalty", Php::Type::Float)
+        });
+        
+        phllama.method<&Phllama::setSeed>("setSeed", {
+            Php::ByVal("seed", Php::Type::Numeric)
+        });
+        
+        phllama.method<&Phllama::setContextShift>("setContextShift", {
+            Php::ByVal("enabled", Php::Type::Bool),
+            Php::ByVal("keep", Php::Type::Numeric, false)
+        });
+        
+        phllama.method<&Phllama::setPromptLookup>("setPromptLookup", {
+            Php::ByVal("draft_tokens", Php::Type::Numeric),
+            Php::ByVal("ngram", Php::Type::Numeric, false)
+        });
+        
         phllama.method<&Phllama::clearCache>("clearCache");
         
         // Utility methods
         phllama.method<&Phllama::getModelInfo>("getModelInfo");
+        phllama.method<&Phllama::getLastGenerationInfo>("getLastGenerationInfo");
         
         // Configuration constants and functions
         extension.add(Php::Constant("PHLLAMA_VERSION", "1.0.0-alpha"));
+        extension.add(Php::Ini("phllama.model_cache_bytes", "0"));
+        extension.add(Php::Ini("phllama.context_pool_size", "4"));
+        extension.add(Php::Ini("phllama.context_idle_timeout_ms", "60000"));
+        extension.add(Php::Ini("phllama.context_reset", "clear"));
+        extension.add(Php::Ini("phllama.auto_clear_cache", "0"));
+        extension.add(Php::Ini("phllama.gpu_mode", "-1"));
+        extension.add(Php::Ini("phllama.gpu_layers", "-1"));
+        extension.add(Php::Ini("phllama.main_gpu", "0"));
+        extension.add(Php::Ini("phllama.cpu_threads", "-1"));
+        extension.add(Php::Ini("phllama.prefill_threads", "-1"));
+        extension.add(Php::Ini("phllama.decode_threads", "-1"));
+        extension.add(Php::Ini("phllama.use_mmap", "1"));
+        extension.add(Php::Ini("phllama.use_mlock", "0"));
+        extension.add(Php::Ini("phllama.numa", "disabled"));
+        extension.add(Php::Ini("phllama.numa_node", "-1"));
+        extension.add(Php::Ini("phllama.cpu_affinity", ""));
+        extension.add(Php::Ini("phllama.prefetch_threads", "0"));
+        extension.add(Php::Ini("phllama.context_size", "2048"));
+        extension.add(Php::Ini("phllama.batch_size", "512"));
+        extension.add(Php::Ini("phllama.thread_pool_size", "-1"));
+        extension.add(Php::Ini("phllama.thread_pool_policy", "interleave"));
+        extension.add(Php::Ini("phllama.abort_on_disconnect", "1"));
+        extension.add(Php::Ini("phllama.max_concurrent", "0"));
+        extension.add(Php::Ini("phllama.admission_timeout_ms", "30000"));
+        extension.add(Php::Ini("phllama.admission_queue_limit", "0"));
+        extension.add(Php::Ini("phllama.admission_fast_fail", "0"));
+        extension.add(Php::Ini("phllama.trace", "0"));
+        extension.add(Php::Ini("phllama.trace_buffer", "65536"));
         extension.add("phllama_set_models_dir", phllama_set_models_dir, {
             Php::ByVal("directory", Php::Type::String)
         });
         extension.add("phllama_get_models_dir", phllama_get_models_dir);
         extension.add("phllama_get_hardware_info", phllama_get_hardware_info);
+        extension.add("phllama_list_models", phllama_list_models);
+        extension.add("phllama_quantize", phllama_quantize, {
+            Php::ByVal("input", Php::Type::String),
+            Php::ByVal("output", Php::Type::String),
+            Php::ByVal("type", Php::Type::String),
+            Php::ByVal("options", Php::Type::Array, false)
+        });
+        extension.add("phllama_admission_stats", phllama_admission_stats);
+        extension.add("phllama_trace_enable", phllama_trace_enable, {
+            Php::ByVal("capacity", Php::Type::Numeric, false)
+        });
+        extension.add("phllama_trace_disable", phllama_trace_disable);
+        extension.add("phllama_trace_clear", phllama_trace_clear);
+        extension.add("phllama_trace_dump", phllama_trace_dump, {
+            Php::ByVal("path", Php::Type::Null, false)
+        });
+        extension.add("phllama_model_cache_info", phllama_model_cache_info);
+        extension.add("phllama_model_cache_clear", phllama_model_cache_clear);
+        extension.add("phllama_context_pool_info", phllama_context_pool_info);
+        extension.add("phllama_context_pool_clear", phllama_context_pool_clear);
+        
+        // The pool's sweeper thread runs code in this library, so it must be gone before unload
+        extension.onShutdown([]() {
+            ContextPool::shutdown();
+        });
         
         extension.add(std::move(phllama));
         
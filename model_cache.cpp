@@ -0,0 +1,230 @@
+#include "model_cache.h"
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    struct CacheEntry {
+        std::string key;
+        std::string path;
+        std::shared_ptr<LlamaModel> model;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        std::chrono::steady_clock::time_point last_used;
+    };
+    
+    // Most recently used entries live at the front of the list
+    std::list<CacheEntry> lru;
+    std::unordered_map<std::string, std::list<CacheEntry>::iterator> index;
+    std::mutex cache_mutex;
+    size_t budget_bytes = 0;
+    size_t resident_bytes = 0;
+    
+    // Loads run without cache_mutex; concurrent requests for the same key wait on the first
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<LlamaModel>>> loading;
+    size_t reserved_bytes = 0; // Estimated size of the loads in flight
+    
+    bool isIdle(const CacheEntry& entry) {
+        return entry.model.use_count() == 1;
+    }
+    
+    // Whether `needed` more bytes fit next to the resident models and loads in flight
+    bool fits(size_t needed) {
+        return resident_bytes + reserved_bytes + needed <= budget_bytes;
+    }
+    
+    // Models dropped from the cache; declared before the lock so that the last reference,
+    // and with it llama_model_free, goes away only after cache_mutex is released
+    using Evicted = std::vector<std::shared_ptr<LlamaModel>>;
+    
+    /**
+     * Remove an entry, moving its model into `evicted`
+     * Caller must hold cache_mutex
+     */
+    std::list<CacheEntry>::iterator evict(std::list<CacheEntry>::iterator it, Evicted& evicted) {
+        resident_bytes -= it->bytes;
+        index.erase(it->key);
+        evicted.push_back(std::move(it->model));
+        return lru.erase(it);
+    }
+    
+    /**
+     * Evict idle entries from the LRU tail until `needed` more bytes fit the budget
+     * Caller must hold cache_mutex
+     */
+    void evictFor(size_t needed, Evicted& evicted) {
+        auto it = lru.end();
+        while (it != lru.begin() && !fits(needed)) {
+            --it;
+            if (!isIdle(*it)) {
+                continue;
+            }
+            it = evict(it, evicted);
+        }
+    }
+}
+
+/**
+ * Return a cached model for `key`, loading it through `loader` on a miss
+ * The load runs without the cache lock, so other keys and cache queries are not held up;
+ * callers asking for a key that is already loading wait for that load instead of repeating it.
+ * Throws if the model cannot fit the budget because in-use models pin the memory
+ */
+std::shared_ptr<LlamaModel> ModelCache::acquire(const std::string& key, const std::string& path,
+                                                size_t estimated_bytes, const Loader& loader) {
+    Evicted evicted;
+    std::unique_lock<std::mutex> lock(cache_mutex);
+    
+    if (budget_bytes == 0) {
+        lock.unlock();
+        size_t bytes = 0;
+        return loader(bytes);
+    }
+    
+    auto found = index.find(key);
+    if (found != index.end()) {
+        auto entry = found->second;
+        entry->hits++;
+        entry->last_used = std::chrono::steady_clock::now();
+        lru.splice(lru.begin(), lru, entry);
+        return entry->model;
+    }
+    
+    auto pending = loading.find(key);
+    if (pending != loading.end()) {
+        std::shared_future<std::shared_ptr<LlamaModel>> result = pending->second;
+        lock.unlock();
+        return result.get(); // Rethrows the loader's error
+    }
+    
+    if (estimated_bytes > budget_bytes) {
+        throw ModelCacheError("Model " + path + " (" + std::to_string(estimated_bytes) +
+                                 " bytes) exceeds model cache budget of " + std::to_string(budget_bytes) + " bytes");
+    }
+    
+    evictFor(estimated_bytes, evicted);
+    if (!fits(estimated_bytes)) {
+        throw ModelCacheError("Model cache budget exhausted by models in use (" +
+                                 std::to_string(resident_bytes + reserved_bytes) + " of " +
+                                 std::to_string(budget_bytes) + " bytes resident or loading); cannot load " + path);
+    }
+    
+    std::promise<std::shared_ptr<LlamaModel>> promise;
+    loading[key] = promise.get_future().share();
+    reserved_bytes += estimated_bytes;
+    lock.unlock();
+    
+    size_t bytes = estimated_bytes;
+    std::shared_ptr<LlamaModel> model;
+    try {
+        model = loader(bytes);
+    } catch (...) {
+        lock.lock();
+        reserved_bytes -= estimated_bytes;
+        loading.erase(key);
+        lock.unlock();
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    
+    lock.lock();
+    reserved_bytes -= estimated_bytes;
+    loading.erase(key);
+    
+    // Caching was switched off during the load: hand the model out uncached
+    if (!model || budget_bytes == 0) {
+        lock.unlock();
+        promise.set_value(model);
+        return model;
+    }
+    
+    // The loaded size can differ from the on-disk estimate; make room for the difference
+    evictFor(bytes, evicted);
+    if (!fits(bytes)) {
+        std::string message = "Model " + path + " loaded at " + std::to_string(bytes) +
+                              " bytes, more than the model cache budget has free (" +
+                              std::to_string(resident_bytes + reserved_bytes) + " of " +
+                              std::to_string(budget_bytes) + " bytes resident or loading)";
+        lock.unlock();
+        model.reset(); // Unload outside the lock
+        promise.set_exception(std::make_exception_ptr(ModelCacheError(message)));
+        throw ModelCacheError(message);
+    }
+    
+    CacheEntry entry;
+    entry.key = key;
+    entry.path = path;
+    entry.model = model;
+    entry.bytes = bytes;
+    entry.last_used = std::chrono::steady_clock::now();
+    lru.push_front(std::move(entry));
+    index[key] = lru.begin();
+    resident_bytes += bytes;
+    lock.unlock();
+    
+    promise.set_value(model);
+    return model;
+}
+
+void ModelCache::setBudget(size_t bytes) {
+    Evicted evicted;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    budget_bytes = bytes;
+    
+    if (budget_bytes == 0) {
+        // Caching disabled: drop every reference; in-use models stay alive with their owners
+        for (auto it = lru.begin(); it != lru.end();) {
+            it = evict(it, evicted);
+        }
+    } else {
+        evictFor(0, evicted);
+    }
+}
+
+size_t ModelCache::getBudget() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return budget_bytes;
+}
+
+size_t ModelCache::getResidentBytes() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return resident_bytes;
+}
+
+std::vector<ModelCache::EntryInfo> ModelCache::getEntries() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    
+    std::vector<EntryInfo> entries;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& entry : lru) {
+        EntryInfo info;
+        info.key = entry.key;
+        info.path = entry.path;
+        info.bytes = entry.bytes;
+        info.users = entry.model.use_count() - 1;
+        info.hits = entry.hits;
+        info.idle_seconds = info.users > 0 ? 0.0 :
+            std::chrono::duration<double>(now - entry.last_used).count();
+        entries.push_back(info);
+    }
+    
+    return entries;
+}
+
+size_t ModelCache::evictIdle() {
+    Evicted evicted;
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    
+    for (auto it = lru.begin(); it != lru.end();) {
+        if (isIdle(*it)) {
+            it = evict(it, evicted);
+        } else {
+            ++it;
+        }
+    }
+    
+    return evicted.size();
+}
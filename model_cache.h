@@ -0,0 +1,54 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+struct LlamaModel;
+
+/**
+ * Raised when a model cannot be made resident within the cache budget
+ */
+class ModelCacheError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Process-level cache of loaded models
+ *
+ * Keeps recently used models resident so that switching between a small set
+ * of hot models does not reload weights. Residency is bounded by a byte budget;
+ * idle models are evicted least-recently-used first when a new load would
+ * exceed it. A budget of 0 disables caching entirely.
+ */
+class ModelCache {
+public:
+    struct EntryInfo {
+        std::string key;
+        std::string path;
+        size_t bytes = 0;
+        long users = 0;          // Live LlamaInterface instances holding the model
+        uint64_t hits = 0;
+        double idle_seconds = 0.0;
+    };
+    
+    // Loads the model and reports its resident size; returns nullptr on failure
+    using Loader = std::function<std::shared_ptr<LlamaModel>(size_t& resident_bytes)>;
+    
+    static std::shared_ptr<LlamaModel> acquire(const std::string& key, const std::string& path,
+                                               size_t estimated_bytes, const Loader& loader);
+    
+    static void setBudget(size_t bytes);
+    static size_t getBudget();
+    static size_t getResidentBytes();
+    static std::vector<EntryInfo> getEntries();
+    static size_t evictIdle(); // Returns number of models evicted
+};
+
+#endif
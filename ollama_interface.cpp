@@ -1,4 +1,6 @@
 #include "ollama_interface.h"
+#include "trace.h"
+#include "gguf_reader.h"
 #include <iostream>
 #include <filesystem>
 #include <cstdlib>
@@ -7,6 +9,8 @@
 #include <regex>
 #include <unordered_map>
 #include <chrono>
+#include <mutex>
+#include <algorithm>
 
 // Static member definition
 std::string OllamaInterface::models_directory = "";
@@ -14,6 +18,7 @@ std::string OllamaInterface::models_directory = "";
 namespace {
     // Cache for model paths to avoid repeated filesystem scans
     std::unordered_map<std::string, std::string> model_cache;
+    std::mutex model_cache_mutex; // Models may be resolved from background load threads
     
     /**
      * Execute a command and capture its output
@@ -38,6 +43,94 @@ namespace {
         
         return result;
     }
+    
+    const std::string default_registry = "registry.ollama.ai";
+    const std::string default_namespace = "library";
+    
+    /**
+     * Map a model name to its manifest path relative to manifests/
+     * "llama3" -> registry.ollama.ai/library/llama3/latest
+     * "user/model:tag" -> registry.ollama.ai/user/model/tag
+     */
+    std::string manifestPathFor(const std::string& model_name) {
+        std::string name = model_name;
+        std::string tag = "latest";
+        
+        size_t colon = name.rfind(':');
+        size_t slash = name.rfind('/');
+        if (colon != std::string::npos && (slash == std::string::npos || colon > slash)) {
+            tag = name.substr(colon + 1);
+            name = name.substr(0, colon);
+        }
+        
+        size_t parts = std::count(name.begin(), name.end(), '/');
+        if (parts == 0) {
+            name = default_registry + "/" + default_namespace + "/" + name;
+        } else if (parts == 1) {
+            name = default_registry + "/" + name;
+        }
+        
+        return name + "/" + tag;
+    }
+    
+    /**
+     * Extract the model layer's blob digest from a manifest
+     */
+    std::string modelDigest(const std::string& manifest_file) {
+        std::ifstream file(manifest_file);
+        if (!file) {
+            return "";
+        }
+        
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string manifest = buffer.str();
+        
+        // Layer objects are flat, so mediaType and digest sit in the same {...}
+        static const std::regex layer_pattern(R"(\{[^{}]*"application/vnd\.ollama\.image\.model"[^{}]*\})");
+        static const std::regex digest_pattern(R"re("digest"\s*:\s*"sha256:([0-9a-fA-F]+)")re");
+        
+        std::smatch layer;
+        if (!std::regex_search(manifest, layer, layer_pattern)) {
+            return "";
+        }
+        
+        std::smatch digest;
+        std::string layer_text = layer.str();
+        if (!std::regex_search(layer_text, digest, digest_pattern)) {
+            return "";
+        }
+        
+        return digest[1].str();
+    }
+    
+    /**
+     * Display name for a manifest path, dropping the default registry and namespace
+     */
+    std::string displayName(const std::filesystem::path& relative) {
+        std::vector<std::string> parts;
+        for (const auto& part : relative) {
+            parts.push_back(part.string());
+        }
+        if (parts.size() < 2) {
+            return relative.string();
+        }
+        
+        std::string tag = parts.back();
+        parts.pop_back();
+        
+        size_t skip = 0;
+        if (parts.size() >= 3 && parts[0] == default_registry) {
+            skip = parts[1] == default_namespace ? 2 : 1;
+        }
+        
+        std::string name;
+        for (size_t i = skip; i < parts.size(); i++) {
+            if (!name.empty()) name += "/";
+            name += parts[i];
+        }
+        return name + ":" + tag;
+    }
 }
 
 /**
@@ -89,11 +182,15 @@ std::string OllamaInterface::downloadModel(const std::string& model_name) {
  * Uses intelligent caching and filesystem scanning
  */
 std::string OllamaInterface::getModelPath(const std::string& model_name) {
+    TraceSpan span("OllamaInterface::getModelPath");
+    
     // Security: Validate model name
     if (model_name.empty() || model_name.length() > 256) {
         throw std::runtime_error("Invalid model name");
     }
     
+    std::lock_guard<std::mutex> lock(model_cache_mutex);
+    
     // Check cache first
     auto cache_it = model_cache.find(model_name);
     if (cache_it != model_cache.end()) {
@@ -130,19 +227,25 @@ std::string OllamaInterface::getModelPath(const std::string& model_name) {
         throw std::runtime_error("Ollama blobs directory not found: " + blobs_dir);
     }
     
+    // Prefer the exact blob named by the model's manifest
+    std::string manifest_file = ollama_dir + "/manifests/" + manifestPathFor(model_name);
+    if (std::filesystem::is_regular_file(manifest_file)) {
+        std::string digest = modelDigest(manifest_file);
+        std::string blob = blobs_dir + "/sha256-" + digest;
+        if (!digest.empty() && std::filesystem::exists(blob)) {
+            model_cache[model_name] = blob;
+            return blob;
+        }
+    }
+    
+    // No usable manifest: fall back to scanning the blobs
     std::vector<std::pair<std::string, std::uintmax_t>> gguf_files;
     
     try {
         for (const auto& entry : std::filesystem::directory_iterator(blobs_dir)) {
             if (!entry.is_regular_file()) continue;
             
-            // Check if it's a GGUF file by reading magic bytes
-            std::ifstream file(entry.path(), std::ios::binary);
-            if (!file) continue;
-            
-            char magic[4];
-            file.read(magic, 4);
-            if (file && std::string(magic, 4) == "GGUF") {
+            if (GGUFReader::isGGUF(entry.path().string())) {
                 auto size = std::filesystem::file_size(entry.path());
                 gguf_files.emplace_back(entry.path().string(), size);
             }
@@ -155,8 +258,7 @@ std::string OllamaInterface::getModelPath(const std::string& model_name) {
         throw std::runtime_error("No GGUF files found in ollama blobs directory for model: " + model_name);
     }
     
-    // For now, return the largest GGUF file (most likely the main model)
-    // TODO: In the future, we could parse ollama's manifest files to be more precise
+    // Return the largest GGUF file (most likely the main model)
     auto largest = std::max_element(gguf_files.begin(), gguf_files.end(),
         [](const auto& a, const auto& b) { return a.second < b.second; });
     
@@ -169,6 +271,58 @@ std::string OllamaInterface::getModelPath(const std::string& model_name) {
     return model_path;
 }
 
+/**
+ * List every model available locally: ollama manifests whose model blob exists,
+ * plus plain .gguf files anywhere else under the models directory
+ */
+std::vector<ModelEntry> OllamaInterface::listModels() {
+    std::vector<ModelEntry> models;
+    std::string models_dir = getModelsDirectory();
+    if (models_dir.empty() || !std::filesystem::is_directory(models_dir)) {
+        return models;
+    }
+    
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    
+    fs::path manifests_dir = fs::path(models_dir) / "manifests";
+    fs::path blobs_dir = fs::path(models_dir) / "blobs";
+    
+    if (fs::is_directory(manifests_dir)) {
+        for (auto it = fs::recursive_directory_iterator(manifests_dir, ec);
+             it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec) break;
+            if (!it->is_regular_file()) continue;
+            
+            std::string digest = modelDigest(it->path().string());
+            if (digest.empty()) continue;
+            
+            fs::path blob = blobs_dir / ("sha256-" + digest);
+            if (!fs::exists(blob)) continue;
+            
+            models.push_back({displayName(fs::relative(it->path(), manifests_dir)), blob.string(), "ollama"});
+        }
+    }
+    
+    ec.clear();
+    for (auto it = fs::recursive_directory_iterator(models_dir, ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) break;
+        if (it->is_directory() && (it->path() == manifests_dir || it->path() == blobs_dir)) {
+            it.disable_recursion_pending();
+            continue;
+        }
+        if (it->is_regular_file() && it->path().extension() == ".gguf") {
+            models.push_back({fs::relative(it->path(), models_dir).string(), it->path().string(), "file"});
+        }
+    }
+    
+    std::sort(models.begin(), models.end(),
+        [](const ModelEntry& a, const ModelEntry& b) { return a.name < b.name; });
+    
+    return models;
+}
+
 /**
  * Tokenize text using the model's tokenizer
  * NOTE: Currently placeholder - tokenization is handled by llama.cpp directly
@@ -195,6 +349,7 @@ std::string OllamaInterface::detokenize(const std::vector<int>& tokens, const st
  * Set custom models directory (useful for non-standard installations)
  */
 void OllamaInterface::setModelsDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(model_cache_mutex);
     models_directory = directory;
     // Clear cache when directory changes
     model_cache.clear();
@@ -4,11 +4,21 @@
 #include <string>
 #include <vector>
 
+/**
+ * A locally available model, from an ollama manifest or a plain GGUF file
+ */
+struct ModelEntry {
+    std::string name;
+    std::string path;
+    std::string source; // "ollama" or "file"
+};
+
 class OllamaInterface {
 public:
     static bool isModelAvailable(const std::string& model_name);
     static std::string downloadModel(const std::string& model_name);
     static std::string getModelPath(const std::string& model_name);
+    static std::vector<ModelEntry> listModels();
     static std::vector<int> tokenize(const std::string& text, const std::string& model_path);
     static std::string detokenize(const std::vector<int>& tokens, const std::string& model_path);
     
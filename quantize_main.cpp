@@ -0,0 +1,86 @@
+/**
+ * phllama-quantize - convert a GGUF model to a quantized type with the vendored llama.cpp
+ */
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cerrno>
+#include <stdexcept>
+#include <getopt.h>
+#include "quantizer.h"
+
+namespace {
+    void usage(const char* program) {
+        std::cerr << "Usage: " << program << " [options] <input.gguf> <output.gguf> <type>\n"
+                  << "\n"
+                  << "  -t, --threads N         quantization threads (default all)\n"
+                  << "      --imatrix FILE      importance matrix from llama-imatrix (.dat)\n"
+                  << "      --allow-requantize  allow re-quantizing an already quantized model\n"
+                  << "      --pure              use <type> for every tensor instead of the mixed layout\n"
+                  << "\n"
+                  << "Types:";
+        for (const auto& type : Quantizer::getTypes()) {
+            std::cerr << " " << type;
+        }
+        std::cerr << "\n";
+    }
+    
+    // Strict --threads: the whole argument must be a count between 1 and 1024
+    int parseThreads(const char* value) {
+        char* end = nullptr;
+        errno = 0;
+        long parsed = std::strtol(value, &end, 10);
+        if (end == value || *end != '\0' || errno == ERANGE || parsed < 1 || parsed > 1024) {
+            throw std::runtime_error(std::string("Invalid value for --threads: ") + value + " (must be between 1 and 1024)");
+        }
+        return static_cast<int>(parsed);
+    }
+}
+
+int main(int argc, char** argv) {
+    static const option long_options[] = {
+        {"threads", required_argument, nullptr, 't'},
+        {"imatrix", required_argument, nullptr, 'i'},
+        {"allow-requantize", no_argument, nullptr, 'r'},
+        {"pure", no_argument, nullptr, 'p'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    
+    QuantizeOptions options;
+    int opt;
+    try {
+        while ((opt = getopt_long(argc, argv, "t:h", long_options, nullptr)) != -1) {
+            switch (opt) {
+                case 't': options.threads = parseThreads(optarg); break;
+                case 'i': options.imatrix_path = optarg; break;
+                case 'r': options.allow_requantize = true; break;
+                case 'p': options.pure = true; break;
+                case 'h': usage(argv[0]); return 0;
+                default: usage(argv[0]); return 2;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "phllama-quantize: " << e.what() << std::endl;
+        return 2;
+    }
+    
+    if (argc - optind != 3) {
+        usage(argv[0]);
+        return 2;
+    }
+    
+    options.progress = [](float progress) {
+        std::cerr << "\r" << static_cast<int>(progress * 100.0f) << "%" << std::flush;
+    };
+    
+    try {
+        QuantizeResult result = Quantizer::quantize(argv[optind], argv[optind + 1], argv[optind + 2], options);
+        std::cerr << "\r" << result.type << ": " << result.input_bytes / (1024 * 1024) << " MB -> "
+                  << result.output_bytes / (1024 * 1024) << " MB in " << result.seconds << " s" << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << std::endl << "phllama-quantize: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,231 @@
+#include "quantizer.h"
+#include "trace.h"
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <iostream>
+
+#include "llama.h"
+
+namespace {
+    const std::map<std::string, llama_ftype> quant_types = {
+        {"F32", LLAMA_FTYPE_ALL_F32},
+        {"F16", LLAMA_FTYPE_MOSTLY_F16},
+        {"BF16", LLAMA_FTYPE_MOSTLY_BF16},
+        {"Q8_0", LLAMA_FTYPE_MOSTLY_Q8_0},
+        {"Q6_K", LLAMA_FTYPE_MOSTLY_Q6_K},
+        {"Q5_K_M", LLAMA_FTYPE_MOSTLY_Q5_K_M},
+        {"Q5_K_S", LLAMA_FTYPE_MOSTLY_Q5_K_S},
+        {"Q5_0", LLAMA_FTYPE_MOSTLY_Q5_0},
+        {"Q5_1", LLAMA_FTYPE_MOSTLY_Q5_1},
+        {"Q4_K_M", LLAMA_FTYPE_MOSTLY_Q4_K_M},
+        {"Q4_K_S", LLAMA_FTYPE_MOSTLY_Q4_K_S},
+        {"Q4_0", LLAMA_FTYPE_MOSTLY_Q4_0},
+        {"Q4_1", LLAMA_FTYPE_MOSTLY_Q4_1},
+        {"Q3_K_L", LLAMA_FTYPE_MOSTLY_Q3_K_L},
+        {"Q3_K_M", LLAMA_FTYPE_MOSTLY_Q3_K_M},
+        {"Q3_K_S", LLAMA_FTYPE_MOSTLY_Q3_K_S},
+        {"Q2_K", LLAMA_FTYPE_MOSTLY_Q2_K},
+        {"Q2_K_S", LLAMA_FTYPE_MOSTLY_Q2_K_S},
+        {"IQ4_NL", LLAMA_FTYPE_MOSTLY_IQ4_NL},
+        {"IQ4_XS", LLAMA_FTYPE_MOSTLY_IQ4_XS},
+        {"IQ3_M", LLAMA_FTYPE_MOSTLY_IQ3_M},
+        {"IQ3_S", LLAMA_FTYPE_MOSTLY_IQ3_S},
+        {"IQ3_XS", LLAMA_FTYPE_MOSTLY_IQ3_XS},
+        {"IQ3_XXS", LLAMA_FTYPE_MOSTLY_IQ3_XXS},
+        {"IQ2_M", LLAMA_FTYPE_MOSTLY_IQ2_M},
+        {"IQ2_S", LLAMA_FTYPE_MOSTLY_IQ2_S},
+        {"IQ2_XS", LLAMA_FTYPE_MOSTLY_IQ2_XS},
+        {"IQ2_XXS", LLAMA_FTYPE_MOSTLY_IQ2_XXS},
+        {"IQ1_M", LLAMA_FTYPE_MOSTLY_IQ1_M},
+        {"IQ1_S", LLAMA_FTYPE_MOSTLY_IQ1_S},
+        {"TQ2_0", LLAMA_FTYPE_MOSTLY_TQ2_0},
+        {"TQ1_0", LLAMA_FTYPE_MOSTLY_TQ1_0},
+    };
+    
+    // Each quantization already uses every core, so they run one at a time
+    std::mutex quantize_mutex;
+    
+    struct LogCapture {
+        const std::function<void(float)>* progress = nullptr;
+        std::string last_error;
+    };
+    
+    /**
+     * Turn llama.cpp's per-tensor "[  12/ 291] blk.0.attn_q.weight ..." lines into progress
+     * Errors are kept for the exception message
+     */
+    void captureLog(LogCapture& capture, int level, const char* text) {
+        if (level == GGML_LOG_LEVEL_ERROR) {
+            capture.last_error = text;
+            while (!capture.last_error.empty() && capture.last_error.back() == '\n') {
+                capture.last_error.pop_back();
+            }
+            return;
+        }
+        
+        int current = 0;
+        int total = 0;
+        if (capture.progress && *capture.progress &&
+            std::sscanf(text, " [ %d/ %d]", &current, &total) == 2 && total > 0) {
+            (*capture.progress)(static_cast<float>(current) / total);
+        }
+    }
+    
+    /**
+     * Load an importance matrix in llama-imatrix's .dat format:
+     * int32 n_entries, then per entry: int32 name_len, name, int32 ncall, int32 nval, float[nval]
+     * Values are stored summed over ncall chunks and normalized here, as llama-quantize does
+     */
+    std::unordered_map<std::string, std::vector<float>> loadImatrix(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Cannot open importance matrix: " + path);
+        }
+        
+        char magic[4] = {};
+        in.read(magic, sizeof(magic));
+        if (in && std::memcmp(magic, "GGUF", 4) == 0) {
+            throw std::runtime_error("GGUF importance matrices are not supported; regenerate with llama-imatrix --output-format dat");
+        }
+        in.seekg(0, std::ios::end);
+        const std::streamoff file_size = in.tellg();
+        in.seekg(0);
+        
+        auto readInt = [&in, &path]() {
+            int32_t value = 0;
+            if (!in.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+                throw std::runtime_error("Truncated importance matrix: " + path);
+            }
+            return value;
+        };
+        
+        std::unordered_map<std::string, std::vector<float>> imatrix;
+        int32_t n_entries = readInt();
+        if (n_entries <= 0) {
+            throw std::runtime_error("Importance matrix has no entries: " + path);
+        }
+        
+        for (int32_t i = 0; i < n_entries; i++) {
+            int32_t name_length = readInt();
+            if (name_length <= 0 || name_length > 4096) {
+                throw std::runtime_error("Corrupt importance matrix: " + path);
+            }
+            std::string name(name_length, '\0');
+            if (!in.read(&name[0], name_length)) {
+                throw std::runtime_error("Truncated importance matrix: " + path);
+            }
+            
+            int32_t ncall = readInt();
+            int32_t nval = readInt();
+            if (ncall < 0 || nval <= 0) {
+                throw std::runtime_error("Corrupt importance matrix entry " + name);
+            }
+            // Sizes come from the file: check them against what is left before allocating
+            if (static_cast<std::streamoff>(nval) * static_cast<std::streamoff>(sizeof(float)) > file_size - in.tellg()) {
+                throw std::runtime_error("Truncated importance matrix: " + path);
+            }
+            
+            std::vector<float>& values = imatrix[name];
+            values.resize(nval);
+            if (!in.read(reinterpret_cast<char*>(values.data()), nval * sizeof(float))) {
+                throw std::runtime_error("Truncated importance matrix: " + path);
+            }
+            if (ncall > 0) {
+                for (float& value : values) {
+                    value /= ncall;
+                }
+            }
+        }
+        
+        return imatrix;
+    }
+}
+
+/**
+ * Quantize `input` into `output` as `type` (e.g. "Q4_K_M")
+ */
+QuantizeResult Quantizer::quantize(const std::string& input, const std::string& output,
+                                   const std::string& type, const QuantizeOptions& options) {
+    std::string upper = type;
+    for (char& c : upper) {
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    
+    auto ftype = quant_types.find(upper);
+    if (ftype == quant_types.end()) {
+        throw std::runtime_error("Unknown quantization type: " + type);
+    }
+    
+    if (!std::filesystem::is_regular_file(input)) {
+        throw std::runtime_error("Input model not found: " + input);
+    }
+    
+    std::error_code ec;
+    if (std::filesystem::equivalent(input, output, ec)) {
+        throw std::runtime_error("Output must differ from the input model");
+    }
+    
+    std::unordered_map<std::string, std::vector<float>> imatrix;
+    if (!options.imatrix_path.empty()) {
+        imatrix = loadImatrix(options.imatrix_path);
+    }
+    
+    llama_model_quantize_params params = llama_model_quantize_default_params();
+    params.ftype = ftype->second;
+    params.nthread = options.threads > 0 ? options.threads : static_cast<int32_t>(std::thread::hardware_concurrency());
+    params.allow_requantize = options.allow_requantize;
+    params.pure = options.pure;
+    if (!imatrix.empty()) {
+        params.imatrix = &imatrix;
+    }
+    
+    std::lock_guard<std::mutex> lock(quantize_mutex);
+    llama_backend_init();
+    
+    LogCapture capture;
+    capture.progress = &options.progress;
+    
+    auto start_time = std::chrono::steady_clock::now();
+    
+    uint32_t status;
+    {
+        // Only this thread's log lines are captured; the trace buffer still sees them too
+        LlamaLogCapture log_capture([&capture](int level, const char* text) {
+            captureLog(capture, level, text);
+        });
+        status = llama_model_quantize(input.c_str(), output.c_str(), &params);
+    }
+    
+    if (status != 0) {
+        std::filesystem::remove(output, ec);
+        throw std::runtime_error("Quantization failed" + (capture.last_error.empty() ? "" : ": " + capture.last_error));
+    }
+    
+    if (options.progress) {
+        options.progress(1.0f);
+    }
+    
+    QuantizeResult result;
+    result.type = upper;
+    result.input_bytes = std::filesystem::file_size(input);
+    result.output_bytes = std::filesystem::file_size(output);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    return result;
+}
+
+std::vector<std::string> Quantizer::getTypes() {
+    std::vector<std::string> types;
+    for (const auto& entry : quant_types) {
+        types.push_back(entry.first);
+    }
+    return types;
+}
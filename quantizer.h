@@ -0,0 +1,36 @@
+#ifndef QUANTIZER_H
+#define QUANTIZER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+struct QuantizeOptions {
+    int threads = -1;             // -1 = all hardware threads
+    std::string imatrix_path;     // llama-imatrix output (.dat), empty = none
+    bool allow_requantize = false; // Permit re-quantizing already quantized tensors (lossy)
+    bool pure = false;            // Use the target type for every tensor, no mixed K-quant layout
+    std::function<void(float)> progress; // 0.0 - 1.0, called on the quantizing thread per tensor
+};
+
+struct QuantizeResult {
+    std::string type;
+    size_t input_bytes = 0;
+    size_t output_bytes = 0;
+    double seconds = 0.0;
+};
+
+/**
+ * Model quantization through the vendored llama.cpp
+ *
+ * Converts a GGUF (typically F16/BF16) to a smaller quantized type in process,
+ * so the output is always readable by the same llama.cpp that will load it.
+ */
+class Quantizer {
+public:
+    static QuantizeResult quantize(const std::string& input, const std::string& output,
+                                   const std::string& type, const QuantizeOptions& options = QuantizeOptions());
+    static std::vector<std::string> getTypes();
+};
+
+#endif
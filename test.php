@@ -127,6 +127,56 @@ function test_direct_file() {
         $response = $agent->sendMessage("Say 'Direct file loading works!'");
         echo "   Response: " . trim($response) . "\n";
         
+        // Test candidate scoring
+        echo "🏷️  Testing candidate scoring...\n";
+        $scores = $agent->score("The capital of France is", [" Paris", " Berlin", " Madrid"]);
+        usort($scores, fn($a, $b) => $b['logprob'] <=> $a['logprob']);
+        echo "   Best candidate: " . trim($scores[0]['candidate']) . " (logprob " . round($scores[0]['logprob'], 3) . ")\n";
+        
+        // Test multi-turn chat with history reuse
+        echo "🗨️  Testing chat...\n";
+        $history = [['role' => 'user', 'content' => 'Name a primary color.']];
+        $reply = $agent->chat($history, ['max_tokens' => 16]);
+        $history[] = ['role' => 'assistant', 'content' => $reply];
+        $history[] = ['role' => 'user', 'content' => 'Name another one.'];
+        $agent->chat($history, ['max_tokens' => 16]);
+        echo "   Second turn reused " . $agent->getLastGenerationInfo()['prompt_tokens_cached'] . " cached prompt tokens\n";
+        
+        // Test JSON output mode
+        echo "🧾 Testing JSON output...\n";
+        $data = $agent->sendMessageJson('Reply with only a JSON object of the form {"city": "...", "country": "..."} for the capital of France.', ['max_tokens' => 64]);
+        echo "   Decoded keys: " . implode(', ', array_keys($data)) . " (stop reason: " . $agent->getLastGenerationInfo()['stop_reason'] . ")\n";
+        
+        // Test JSON output behind prose containing a bracket; greedy decoding copies the pattern,
+        // so the plain reply shows what sendMessageJson() had to skip
+        echo "🧾 Testing JSON output after bracketed prose...\n";
+        $agent->setTemperature(0.0);
+        $line = 'see [1] below: {"city": "Paris"}';
+        $prose_prompt = "Copy each line exactly.\nLine: $line\nCopy: $line\nLine: $line\nCopy:";
+        $raw = ltrim($agent->sendMessage($prose_prompt, ['max_tokens' => 24]));
+        $bracket = strpos($raw, '[');
+        $brace = strpos($raw, '{');
+        if ($bracket === false || $brace === false || $bracket > $brace) {
+            echo "⚠️  Model did not lead with bracketed prose, case not exercised: " . trim($raw) . "\n";
+        } else {
+            $data = $agent->sendMessageJson($prose_prompt, ['max_tokens' => 24]);
+            echo (($data['city'] ?? null) === 'Paris' ? "✅" : "❌") . " Decoded " . json_encode($data) . " from: " . trim($raw) . "\n";
+        }
+        $agent->setTemperature(0.5);
+        
+        // Test prompt lookup decoding on a copy-heavy prompt
+        echo "📋 Testing prompt lookup decoding...\n";
+        $agent->setPromptLookup(8);
+        $agent->sendMessage("Repeat exactly: The quick brown fox jumps over the lazy dog.", ['max_tokens' => 32]);
+        $lookup = $agent->getLastGenerationInfo();
+        echo "   Accepted " . $lookup['draft_accepted'] . " of " . $lookup['draft_tokens'] . " drafted tokens\n";
+        $agent->setPromptLookup(0);
+        
+        // Test parallel completions from one prefill
+        echo "🔀 Testing n completions...\n";
+        $variants = $agent->sendMessage("Suggest a subject line for a product launch email:", ['n' => 3, 'max_tokens' => 24]);
+        echo "   Got " . count($variants) . " completions\n";
+        
         echo "✅ Direct file test completed successfully\n\n";
         
     } catch (Exception $e) {
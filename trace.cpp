@@ -0,0 +1,209 @@
+#include "trace.h"
+#include "json_util.h"
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "llama.h"
+
+std::atomic<bool> Trace::enabled{false};
+
+namespace {
+    struct TraceEvent {
+        const char* name;      // Static string
+        const char* category;  // Static string
+        char phase;            // 'X' complete, 'i' instant
+        int64_t ts_us;
+        int64_t duration_us;
+        int tid;
+        std::string args;      // JSON object members, without braces
+    };
+    
+    std::mutex buffer_mutex;
+    std::vector<TraceEvent> buffer; // Ring buffer of `capacity` events
+    size_t capacity = 0;
+    size_t next_slot = 0;
+    size_t recorded = 0;
+    
+    int currentTid() {
+        thread_local int tid = static_cast<int>(syscall(SYS_gettid));
+        return tid;
+    }
+    
+    void push(TraceEvent&& event) {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        if (capacity == 0) {
+            return;
+        }
+        if (buffer.size() < capacity) {
+            buffer.push_back(std::move(event));
+        } else {
+            buffer[next_slot] = std::move(event);
+        }
+        next_slot = (next_slot + 1) % capacity;
+        recorded++;
+    }
+    
+    const char* levelName(int level) {
+        switch (level) {
+            case GGML_LOG_LEVEL_DEBUG: return "debug";
+            case GGML_LOG_LEVEL_INFO: return "info";
+            case GGML_LOG_LEVEL_WARN: return "warn";
+            case GGML_LOG_LEVEL_ERROR: return "error";
+            default: return "log";
+        }
+    }
+    
+    thread_local LlamaLogCapture* thread_capture = nullptr;
+    
+    void onLlamaLog(ggml_log_level level, const char* text, void*) {
+        if (thread_capture) {
+            thread_capture->handle(level, text);
+        }
+        if (Trace::isEnabled()) {
+            Trace::log(level, text);
+        } else if (!thread_capture) {
+            // What llama.cpp's default logger does
+            std::fputs(text, stderr);
+            std::fflush(stderr);
+        }
+    }
+    
+    // llama.cpp's logger is process-wide; remember whether ours is the one installed
+    std::mutex logger_mutex;
+    bool logger_installed = false;
+    size_t active_captures = 0;
+    
+    /**
+     * Install our logger while tracing or a capture needs it, and restore llama.cpp's
+     * default once neither does; caller must hold logger_mutex
+     */
+    void updateLogger() {
+        bool wanted = Trace::isEnabled() || active_captures > 0;
+        if (wanted != logger_installed) {
+            llama_log_set(wanted ? onLlamaLog : nullptr, nullptr);
+            logger_installed = wanted;
+        }
+    }
+}
+
+int64_t Trace::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::enable(size_t new_capacity) {
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        if (new_capacity != capacity) {
+            buffer.clear();
+            buffer.reserve(new_capacity);
+            capacity = new_capacity;
+            next_slot = 0;
+            recorded = 0;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(logger_mutex);
+    enabled.store(capacity > 0, std::memory_order_relaxed);
+    updateLogger();
+}
+
+void Trace::disable() {
+    std::lock_guard<std::mutex> lock(logger_mutex);
+    enabled.store(false, std::memory_order_relaxed);
+    updateLogger(); // Stays installed while a capture is active
+}
+
+LlamaLogCapture::LlamaLogCapture(Handler handler) : handler(std::move(handler)), previous(thread_capture) {
+    std::lock_guard<std::mutex> lock(logger_mutex);
+    thread_capture = this;
+    active_captures++;
+    updateLogger();
+}
+
+LlamaLogCapture::~LlamaLogCapture() {
+    std::lock_guard<std::mutex> lock(logger_mutex);
+    thread_capture = previous;
+    active_captures--;
+    updateLogger();
+}
+
+void Trace::clear() {
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    buffer.clear();
+    next_slot = 0;
+    recorded = 0;
+}
+
+void Trace::complete(const char* name, const char* category, int64_t start_us, int64_t duration_us,
+                     const std::string& args) {
+    push(TraceEvent{name, category, 'X', start_us, duration_us, currentTid(), args});
+}
+
+void Trace::instant(const char* name, const char* category, const std::string& message) {
+    if (!isEnabled()) {
+        return;
+    }
+    push(TraceEvent{name, category, 'i', nowUs(), 0, currentTid(), "\"message\":" + jsonEscape(message)});
+}
+
+/**
+ * llama.cpp emits lines in fragments (GGML_LOG_LEVEL_CONT); one instant event per line
+ */
+void Trace::log(int level, const char* text) {
+    if (!isEnabled()) {
+        return;
+    }
+    
+    thread_local std::string line;
+    thread_local int line_level = GGML_LOG_LEVEL_INFO;
+    if (level != GGML_LOG_LEVEL_CONT) {
+        line_level = level;
+    }
+    line += text;
+    
+    size_t newline;
+    while ((newline = line.find('\n')) != std::string::npos) {
+        if (newline > 0) {
+            instant(levelName(line_level), "llama.cpp", line.substr(0, newline));
+        }
+        line.erase(0, newline + 1);
+    }
+}
+
+/**
+ * Export the buffer, oldest event first, in Chrome trace event format
+ */
+std::string Trace::dumpJson() {
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    
+    const int pid = static_cast<int>(getpid());
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":" +
+        std::to_string(recorded - buffer.size()) + "},\"traceEvents\":[";
+    
+    size_t start = buffer.size() < capacity ? 0 : next_slot;
+    for (size_t i = 0; i < buffer.size(); i++) {
+        const TraceEvent& event = buffer[(start + i) % buffer.size()];
+        if (i > 0) {
+            json += ",";
+        }
+        json += "{\"name\":" + jsonEscape(event.name) + ",\"cat\":" + jsonEscape(event.category) +
+                ",\"ph\":\"" + event.phase + "\",\"ts\":" + std::to_string(event.ts_us) +
+                ",\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(event.tid);
+        if (event.phase == 'X') {
+            json += ",\"dur\":" + std::to_string(event.duration_us);
+        } else {
+            json += ",\"s\":\"t\"";
+        }
+        if (!event.args.empty()) {
+            json += ",\"args\":{" + event.args + "}";
+        }
+        json += "}";
+    }
+    
+    return json + "]}";
+}
@@ -0,0 +1,92 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Per-process trace recorder
+ *
+ * Spans and llama.cpp log lines are kept in a fixed-size ring buffer (oldest
+ * dropped first) and exported as Chrome trace JSON, loadable in chrome://tracing
+ * or ui.perfetto.dev. While tracing is off, a span costs one relaxed load and branch.
+ */
+class Trace {
+public:
+    static void enable(size_t capacity = 65536); // Also routes llama.cpp logging into the buffer (see LlamaLogCapture)
+    static void disable();
+    static void clear();
+    static std::string dumpJson();
+    
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static int64_t nowUs();
+    
+    static void complete(const char* name, const char* category, int64_t start_us, int64_t duration_us,
+                         const std::string& args = "");
+    static void instant(const char* name, const char* category, const std::string& message);
+    static void log(int level, const char* text); // Buffers llama.cpp log fragments into whole lines
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+/**
+ * Receives the llama.cpp log lines emitted on the constructing thread for its lifetime
+ *
+ * llama.cpp has one process-wide logger. This module is its only owner: captures and
+ * the trace buffer are fed from the same callback, so neither swaps the other out, and
+ * llama.cpp's default logger is restored once nothing needs the callback any more.
+ * Lines from other threads keep going to stderr (or the trace buffer) meanwhile.
+ */
+class LlamaLogCapture {
+public:
+    using Handler = std::function<void(int level, const char* text)>;
+    
+    explicit LlamaLogCapture(Handler handler);
+    ~LlamaLogCapture();
+    
+    LlamaLogCapture(const LlamaLogCapture&) = delete;
+    LlamaLogCapture& operator=(const LlamaLogCapture&) = delete;
+    
+    void handle(int level, const char* text) const { handler(level, text); }
+
+private:
+    Handler handler;
+    LlamaLogCapture* previous; // Captures nest per thread
+};
+
+/**
+ * RAII span recorded as a Chrome "complete" event
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, const char* category = "phllama")
+        : name(name), category(category), start_us(Trace::isEnabled() ? Trace::nowUs() : -1) {}
+    
+    ~TraceSpan() {
+        if (start_us >= 0) {
+            Trace::complete(name, category, start_us, Trace::nowUs() - start_us, args);
+        }
+    }
+    
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+    
+    // Numeric argument shown in the trace viewer; skipped while tracing is off
+    void arg(const char* key, int64_t value) {
+        if (start_us >= 0) {
+            args += (args.empty() ? "\"" : ",\"") + std::string(key) + "\":" + std::to_string(value);
+        }
+    }
+
+private:
+    const char* name;
+    const char* category;
+    int64_t start_us;
+    std::string args;
+};
+
+#endif